@@ -27,4 +27,9 @@ Fahrenheit celsius_to_fahrenheit(Celsius c);
 char* strdup_safe(const char* s);
 void* malloc_safe(size_t size);
 
+// Canonical form of a city name for lookups: ASCII lowercased, trimmed,
+// inner runs of spaces collapsed. Returns its length, or 0 if it is empty
+// or doesn't fit in size bytes.
+size_t city_normalize(const char* city, char* out, size_t size);
+
 #endif // CORE_H
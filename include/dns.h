@@ -0,0 +1,26 @@
+#ifndef DNS_H
+#define DNS_H
+
+#include <sys/socket.h>
+
+#define DNS_MAX_ADDRS 8
+#define DNS_CACHE_TTL 300 // seconds
+
+typedef struct {
+    struct sockaddr_storage addr;
+    socklen_t len;
+} DnsAddress;
+
+// Resolve host to up to max addresses (IPv4 and IPv6, in getaddrinfo's
+// preference order) with port filled in. Results are cached per host for
+// DNS_CACHE_TTL seconds; lookups are thread-safe.
+// Returns the number of addresses, or 0 if the host can't be resolved.
+int dns_resolve(const char* host, int port, DnsAddress* out, int max);
+
+// Forget a host, e.g. after none of its addresses accepted a connection
+void dns_invalidate(const char* host);
+
+// Drop every cached entry
+void dns_cache_clear(void);
+
+#endif // DNS_H
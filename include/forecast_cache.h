@@ -0,0 +1,39 @@
+#ifndef FORECAST_CACHE_H
+#define FORECAST_CACHE_H
+
+#include <stddef.h>
+#include <time.h>
+#include "weather.h"
+
+// In-process LRU of parsed forecasts, so asking for the same place again
+// in one session is a memory lookup. Entries expire at the next model
+// refresh boundary, when the upstream data could actually have changed.
+
+#define FORECAST_CACHE_BUDGET (256 * 1024) // bytes
+#define FORECAST_MODEL_CADENCE 3600        // seconds between model updates
+
+typedef struct ForecastCache ForecastCache;
+
+// budget bounds the bytes held by entries; cadence is the update period
+// expiry is aligned to
+ForecastCache* forecast_cache_new(size_t budget, time_t cadence);
+void forecast_cache_free(ForecastCache* cache);
+
+// A copy of the entry for key, or NULL if there is none or it has expired
+Forecast* forecast_cache_get(ForecastCache* cache, const char* key, time_t now);
+
+// Like forecast_cache_get, but an expired entry is still returned, with
+// *stale set, instead of being dropped
+Forecast* forecast_cache_get_stale(ForecastCache* cache, const char* key, time_t now, int* stale);
+
+// Store a copy of fc fetched at now, evicting least recently used entries
+// to stay within the budget. Thread-safe, like forecast_cache_get.
+void forecast_cache_put(ForecastCache* cache, const char* key, const Forecast* fc, time_t now);
+
+// When data fetched at now goes stale: the next cadence boundary
+time_t forecast_cache_expiry(time_t now, time_t cadence);
+
+// Bytes currently charged against the budget
+size_t forecast_cache_size(ForecastCache* cache);
+
+#endif // FORECAST_CACHE_H
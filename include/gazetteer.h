@@ -0,0 +1,65 @@
+#ifndef GAZETTEER_H
+#define GAZETTEER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "weather.h"
+
+// Built-in table of the most populous cities, generated at build time
+// from data/cities.csv by tools/gazetteer_gen. Names (and aliases) are
+// placed with a minimal perfect hash, so a lookup costs two hashes and one
+// string compare and needs no network. The same places, without aliases,
+// form a static k-d tree for finding the one nearest a coordinate.
+
+#define GAZETTEER_KEY_MAX 64
+
+typedef struct {
+    const char* key;        // normalized name or alias
+    const char* name;
+    const char* country;
+    double lat;
+    double lon;
+} GazetteerEntry;
+
+// A point of the k-d tree. The tree is implicit: the root of a range of
+// places is its middle one, which splits the rest on axis.
+typedef struct {
+    const char* name;
+    const char* country;
+    double lat;
+    double lon;
+    double xyz[3];          // position on the unit sphere
+    int axis;
+} GazetteerPlace;
+
+// Generated tables: entry i sits where gazetteer_hash(key, displace[b])
+// lands, b being the key's bucket under seed 0
+extern const GazetteerEntry gazetteer_entries[];
+extern const size_t gazetteer_count;
+extern const uint32_t gazetteer_displace[];
+extern const size_t gazetteer_bucket_count;
+extern const GazetteerPlace gazetteer_places[];
+extern const size_t gazetteer_place_count;
+
+// One hash of a seeded family; shared by the generator and the lookup
+static inline uint32_t gazetteer_hash(const char* key, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed * 0x9e3779b9u;
+    for (const unsigned char* p = (const unsigned char*)key; *p; p++) {
+        h = (h ^ *p) * 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    return h ^ h >> 16;
+}
+
+// Fill out with the city's location; 0 if it isn't in the table. out owns
+// its name and country strings.
+int gazetteer_lookup(const char* city, Location* out);
+
+// The place nearest to lat, lon, with its great-circle distance in km;
+// NULL if the table is empty
+const GazetteerPlace* gazetteer_nearest(double lat, double lon, double* km);
+
+#endif // GAZETTEER_H
@@ -0,0 +1,33 @@
+#ifndef GEOCACHE_H
+#define GEOCACHE_H
+
+#include "weather.h"
+
+// Persistent city -> location cache: a fixed-size open-addressing table in
+// a memory-mapped file, shared by every process that opens it. Readers
+// take no locks; a writer that dies mid-update cannot leave a torn entry
+// behind.
+typedef struct GeoCache GeoCache;
+
+typedef enum {
+    GEOCACHE_MISS,
+    GEOCACHE_FOUND,
+    GEOCACHE_NOT_FOUND     // the geocoder recently had no match
+} GeoCacheResult;
+
+// Open or create the cache file; NULL if it can't be used
+GeoCache* geocache_open(const char* path);
+void geocache_close(GeoCache* cache);
+
+// Cities are matched case-insensitively with runs of spaces collapsed.
+// On GEOCACHE_FOUND, out gets its own name and country strings.
+GeoCacheResult geocache_lookup(GeoCache* cache, const char* city, Location* out);
+
+// Remember where city is, or with loc NULL that it wasn't found
+void geocache_store(GeoCache* cache, const char* city, const Location* loc);
+
+// The cache find_location uses: $WEATHER_GEOCACHE if set (empty turns the
+// cache off), else $XDG_CACHE_HOME or ~/.cache, under weather-c/
+GeoCache* geocache_default(void);
+
+#endif // GEOCACHE_H
@@ -0,0 +1,38 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include <stddef.h>
+
+// Snapping coordinates to forecast model cells. Points in the same cell
+// get the same data upstream, so they share one cache key and one request
+// for the cell's centre.
+
+typedef enum {
+    GRID_NONE,      // keep coordinates as given
+    GRID_DEGREES,   // square cells of step degrees
+    GRID_GEOHASH    // geohash cells of precision characters
+} GridKind;
+
+typedef struct {
+    GridKind kind;
+    double step;
+    int precision;
+} GridSpec;
+
+#define GRID_KEY_MAX 48
+#define GEOHASH_MAX 12
+
+// Parse "none", a step in degrees such as "0.1", or "geohash:N" with N
+// from 1 to GEOHASH_MAX; -1 if malformed
+int grid_parse(const char* text, GridSpec* spec);
+
+// Key of the cell holding lat, lon, and the point requests use for it.
+// With GRID_NONE the point is unchanged and the key is its coordinates at
+// the four decimals requests carry.
+void grid_snap(const GridSpec* spec, double lat, double lon,
+               char key[GRID_KEY_MAX], double* cell_lat, double* cell_lon);
+
+// Standard base-32 geohash of precision characters (out holds precision + 1)
+void geohash_encode(double lat, double lon, int precision, char* out);
+
+#endif // GRID_H
@@ -1,9 +1,66 @@
 #ifndef HTTP_H
 #define HTTP_H
 
+#include <stddef.h>
+
 // Perform HTTP GET request
 // Returns response body (caller must free)
 // Returns NULL on error
 char* http_get(const char* url);
 
+// Receives body bytes (decoded) as they arrive; return nonzero to abort
+typedef int (*HttpBodyFn)(const char* data, size_t len, void* user_data);
+
+// GET url and pass the body to on_data piece by piece instead of
+// buffering it, so memory stays constant whatever the body size. Honours
+// the timeouts but is never retried or hedged. Returns 0 if the whole
+// body of a 200 response was delivered, -1 otherwise.
+int http_get_stream(const char* url, HttpBodyFn on_data, void* user_data);
+
+// Limits applied to every request. Timeouts are in milliseconds, 0 means
+// no limit.
+typedef struct {
+    int connect_timeout_ms;      // per attempt, per address
+    int first_byte_timeout_ms;   // request sent -> first byte of the response
+    int total_timeout_ms;        // whole http_get call, retries included
+    int max_retries;             // extra attempts after a network error, 429 or 5xx
+    int backoff_base_ms;         // retry waits are random, up to base * 2^attempt
+    int backoff_max_ms;
+    int hedge_delay_ms;          // send a duplicate if no answer by then (0 = off)
+} HttpOptions;
+
+// Replace the current options; NULL restores the defaults.
+// Batch requests honour the timeouts but are neither retried nor hedged.
+void http_set_options(const HttpOptions* opts);
+void http_get_options(HttpOptions* opts);
+
+// One entry of a batch fetch. The caller sets url; http_get_many fills
+// in the rest.
+typedef struct {
+    const char* url;
+    char* body;          // response body on success (caller must free)
+    size_t body_len;
+    int status;          // HTTP status code, 0 if no response arrived
+    const char* error;   // static message on failure, NULL on success
+} HttpRequest;
+
+// Called as each request of a batch finishes, successful or not
+typedef void (*HttpCompletionFn)(HttpRequest* req, void* user_data);
+
+// Fetch many URLs concurrently on non-blocking sockets.
+// At most max_concurrent requests are in flight (<= 0 picks a default).
+// on_complete may be NULL. Returns the number of successful requests.
+int http_get_many(HttpRequest* reqs, size_t count, int max_concurrent,
+                  HttpCompletionFn on_complete, void* user_data);
+
+// Fetch URLs by pipelining: requests for the same host are written
+// back-to-back on one connection and the responses read in order. If the
+// server closes the connection early, the remaining requests are fetched
+// one at a time. Fills reqs like http_get_many and returns the number of
+// successful requests.
+int http_get_pipelined(HttpRequest* reqs, size_t count);
+
+// Close all idle keep-alive connections held by the pool
+void http_cleanup(void);
+
 #endif // HTTP_H
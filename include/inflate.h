@@ -0,0 +1,42 @@
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <stddef.h>
+
+// Streaming DEFLATE decoder (RFC 1951) with zlib (RFC 1950) and gzip
+// (RFC 1952) framing. Compressed input may be fed in pieces of any size;
+// decoding resumes where the previous piece ran out.
+
+typedef enum {
+    INFLATE_RAW,
+    INFLATE_ZLIB,
+    INFLATE_GZIP,
+    INFLATE_AUTO     // zlib if the stream starts with a valid zlib header, else raw
+} InflateFormat;
+
+typedef enum {
+    INFLATE_NEED_MORE,   // all input consumed, stream not finished yet
+    INFLATE_DONE,        // end of stream reached and checksum verified
+    INFLATE_ERROR
+} InflateStatus;
+
+typedef struct Inflater Inflater;
+
+Inflater* inflater_new(InflateFormat format);
+void inflater_free(Inflater* inf);
+
+// Decode as much as possible from data. Bytes after the end of the stream
+// are ignored.
+InflateStatus inflater_feed(Inflater* inf, const unsigned char* data, size_t len);
+
+// Hand over the decompressed output (NUL-terminated, caller must free).
+// The inflater is left empty.
+char* inflater_take_output(Inflater* inf, size_t* len);
+
+// Streaming alternative to inflater_take_output: the output decoded since
+// the last drain. It stays valid until the next feed, after which the
+// inflater keeps only the history it still needs, so memory stays bounded
+// however long the stream is. Don't mix with inflater_take_output.
+const char* inflater_drain(Inflater* inf, size_t* len);
+
+#endif // INFLATE_H
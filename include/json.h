@@ -2,6 +2,7 @@
 #define JSON_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 typedef enum {
     JSON_NULL,
@@ -21,33 +22,195 @@ struct JsonValue {
     union {
         int bool_val;
         double number_val;
-        char* string_val;
+        struct {
+            char* string_val;
+            size_t string_len;   // bytes, which may include decoded \u0000
+        };
         JsonArray* array_val;
         JsonObject* object_val;
     } data;
 };
 
+// An array holding only numbers and nulls (at least one number) is packed:
+// items is NULL and the elements are in numbers, with NaN and a set bit in
+// nulls (bit i % 8 of byte i / 8) for each null. nulls is NULL if there
+// are none.
 struct JsonArray {
     JsonValue** items;
     size_t count;
+    double* numbers;
+    unsigned char* nulls;
 };
 
 struct JsonObject {
     char** keys;
     JsonValue** values;
     size_t count;
+    uint32_t* hashes;     // hash of each key
+    uint32_t* slots;      // open-addressing index of entry + 1, 0 = empty;
+                          // NULL below JSON_OBJECT_INDEX_MIN entries
+    size_t slot_mask;     // slot count - 1
 };
 
+// Objects with at least this many entries get a hash index
+#define JSON_OBJECT_INDEX_MIN 8
+
 // Parse JSON string
 JsonValue* json_parse(const char* json_str);
 
 // Free JSON value
 void json_free(JsonValue* val);
 
+// Arena for request-scoped documents: every node of a tree parsed into it
+// lives in a few large blocks that are released together.
+typedef struct JsonArena JsonArena;
+
+// block_size 0 picks a default
+JsonArena* json_arena_new(size_t block_size);
+
+// Drop everything parsed into the arena; its memory is kept for reuse
+void json_arena_reset(JsonArena* arena);
+void json_arena_free(JsonArena* arena);
+
+// Bytes currently reserved by the arena
+size_t json_arena_capacity(const JsonArena* arena);
+
+// Parse JSON string into arena. The tree stays valid until the arena is
+// reset or freed; do not json_free it.
+JsonValue* json_parse_arena(const char* json_str, JsonArena* arena);
+
+// Parse into arena without copying strings: every string and key points
+// into json_str, which is rewritten in place (closing quotes become NULs,
+// escapes are decoded where they stand) and must outlive the tree. The
+// buffer is modified even if parsing fails.
+JsonValue* json_parse_insitu(char* json_str, JsonArena* arena);
+
+// Write val as compact JSON (NUL-terminated, caller must free). Numbers
+// read back to the same double whatever the locale; NaN (a null in a
+// packed array) is written as null.
+char* json_serialize(const JsonValue* val, size_t* len);
+
+// Binary image of a tree: the nodes laid out as they are in memory, with
+// every pointer stored as an offset into the image and listed in a
+// relocation table. Loading rebases those pointers in place and hands
+// back the root, so nothing is parsed and the usual accessors work on
+// the result. An image is only portable between builds with the same
+// pointer size and byte order. Caller must free the encoded image.
+void* json_binary_encode(const JsonValue* val, size_t* len);
+
+// Rebase an image where it lies; it must be writable and stay put while
+// the tree is in use. The whole image is checked first, in one pass: every
+// node must lie inside it without overlapping another, and the relocation
+// table must name exactly the tree's pointers. NULL, with the image left
+// untouched, if it is not a valid image. Loading an image again, or after
+// it has been copied elsewhere, is fine. Never json_free the result.
+JsonValue* json_binary_load(void* image, size_t len);
+
+// Map a file holding an image (privately, so the file is not changed)
+// and load it
+typedef struct {
+    void* addr;
+    size_t len;
+} JsonMapping;
+
+JsonValue* json_binary_map(const char* path, JsonMapping* map);
+void json_binary_unmap(JsonMapping* map);
+
+// Pull parser for input that arrives in pieces. Feed chunks of any size
+// and pull tokens; a token split across chunks is resumed where it
+// stopped. Memory use depends on nesting depth and the longest string,
+// not on document size.
+typedef struct JsonReader JsonReader;
+
+typedef enum {
+    JSON_TOKEN_OBJECT_START,
+    JSON_TOKEN_OBJECT_END,
+    JSON_TOKEN_ARRAY_START,
+    JSON_TOKEN_ARRAY_END,
+    JSON_TOKEN_KEY,
+    JSON_TOKEN_STRING,
+    JSON_TOKEN_NUMBER,
+    JSON_TOKEN_BOOL,
+    JSON_TOKEN_NULL,
+    JSON_TOKEN_NEED_MORE,   // chunk used up; feed the next one
+    JSON_TOKEN_END,         // document complete
+    JSON_TOKEN_ERROR
+} JsonTokenType;
+
+typedef struct {
+    JsonTokenType type;
+    const char* string;     // KEY and STRING, decoded and NUL-terminated;
+    size_t string_len;      // valid until the next call
+    double number;
+    int bool_val;
+    int depth;              // nesting level the token appears at
+} JsonToken;
+
+JsonReader* json_reader_new(void);
+void json_reader_free(JsonReader* reader);
+
+// Make data the next input. Only call before the first token or after
+// JSON_TOKEN_NEED_MORE; data must stay valid until then.
+void json_reader_feed(JsonReader* reader, const char* data, size_t len);
+
+// No more input will follow
+void json_reader_finish(JsonReader* reader);
+
+// Next token; tok is filled in for value and structure tokens
+JsonTokenType json_reader_next(JsonReader* reader, JsonToken* tok);
+
+// Pass over the rest of the object or array just started, without
+// decoding or validating its contents, and return its END token. After
+// JSON_TOKEN_NEED_MORE, feed and call json_reader_next to continue.
+JsonTokenType json_reader_skip(JsonReader* reader, JsonToken* tok);
+
+// Path queries: pull a few values out of a document without building a
+// tree. Paths are dot-separated keys with array steps, e.g.
+// "daily.time[*]" or "results[0].latitude". Everything the paths don't
+// reach is skipped unread.
+typedef struct JsonQuery JsonQuery;
+
+typedef enum {
+    JSON_QUERY_NUMBER,      // out is double[max]; non-numbers become NaN
+    JSON_QUERY_STRING       // out is char[max][width]; non-strings become ""
+} JsonQueryType;
+
+// Where the matches of one path go. count is set by json_query_run; every
+// match takes a slot, so values from parallel arrays stay aligned.
+typedef struct {
+    JsonQueryType type;
+    void* out;
+    size_t max;
+    size_t width;           // bytes per string slot, NUL included
+    size_t count;
+} JsonQueryField;
+
+// Compile paths once for any number of runs; NULL if a path is malformed
+JsonQuery* json_query_compile(const char* const* paths, size_t count);
+void json_query_free(JsonQuery* query);
+
+// Match json against the query, filling fields[i] for paths[i].
+// Returns 0, or -1 if the document is malformed.
+int json_query_run(const JsonQuery* query, const char* json, size_t len,
+                   JsonQueryField* fields);
+
+// A key hashed once for repeated lookups
+typedef struct {
+    const char* name;
+    uint32_t hash;
+} JsonKey;
+
+JsonKey json_key(const char* name);
+
 // Accessors
 JsonValue* json_object_get(JsonValue* obj, const char* key);
+JsonValue* json_object_get_key(JsonValue* obj, const JsonKey* key);
 double json_as_number(JsonValue* val, double default_val);
 const char* json_as_string(JsonValue* val, const char* default_val);
 JsonArray* json_as_array(JsonValue* val);
 
+// The elements of a packed numeric array, or NULL for any other value.
+// nulls may be NULL if the caller doesn't need the null bitmap.
+const double* json_as_double_array(JsonValue* val, size_t* count, const unsigned char** nulls);
+
 #endif // JSON_H
@@ -0,0 +1,30 @@
+#ifndef JSON_INDEX_H
+#define JSON_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// First pass of the DOM parser: classifies the input 64 bytes at a time
+// and records where every token starts, so the recursive descent never
+// looks at whitespace or string contents one byte at a time.
+
+typedef enum {
+    JSON_INDEX_AUTO,     // best kernel the CPU supports
+    JSON_INDEX_SCALAR,
+    JSON_INDEX_SSE2,
+    JSON_INDEX_AVX2
+} JsonIndexKernel;
+
+// Offsets of every structural character ({}[]:,) outside strings, both
+// quotes of every string, and the first byte of every other token
+// (numbers, literals, stray characters). The list ends with len
+// itself. Returns the number of entries including that end marker;
+// *positions must be freed by the caller. Input of 4 GiB or more is not
+// indexed and returns 0.
+size_t json_index_build(const char* json, size_t len, uint32_t** positions);
+
+// Select the kernel used by json_index_build; -1 if this CPU or build
+// lacks it. Meant for tests and benchmarks.
+int json_index_set_kernel(JsonIndexKernel kernel);
+
+#endif // JSON_INDEX_H
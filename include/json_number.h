@@ -0,0 +1,10 @@
+#ifndef JSON_NUMBER_H
+#define JSON_NUMBER_H
+
+// Parse the JSON number at s: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+// Stores the correctly rounded double in *out and returns the first byte
+// after the number, or NULL if s does not start with one. The result does
+// not depend on the process locale.
+const char* json_number_parse(const char* s, double* out);
+
+#endif // JSON_NUMBER_H
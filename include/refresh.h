@@ -0,0 +1,47 @@
+#ifndef REFRESH_H
+#define REFRESH_H
+
+#include <time.h>
+#include "weather.h"
+
+// Background refresh of a watch list of locations. A scheduler thread
+// re-fetches each one shortly before its cached forecast expires, at a
+// jittered moment so many watchers don't all hit the API together.
+// get_forecast answers watched locations from memory, even stale, and
+// asks for a revalidation instead of waiting on the network.
+
+#define REFRESH_LEAD 300     // seconds before a model update refreshes spread over
+#define REFRESH_RETRY 60     // seconds before retrying a failed refresh
+
+// Fetch a location's forecast into the caches; 0 on success
+typedef int (*RefreshFn)(Location* location);
+
+// Start the scheduler thread (once) for forecasts that expire every
+// cadence seconds; -1 if it can't be created
+int refresh_start(RefreshFn fn, time_t cadence);
+
+// Stop the thread and forget every watched location
+void refresh_stop(void);
+
+// Keep a location's forecast fresh, starting after the next model update
+// (callers have usually just fetched it)
+void refresh_watch(const Location* location);
+void refresh_unwatch(const Location* location);
+
+// 1 if a running scheduler watches the location
+int refresh_watching(const Location* location);
+
+// Ask for a watched location to be refreshed now, without waiting for it
+void refresh_revalidate(const Location* location);
+
+// How far ahead of a model update refreshes run: REFRESH_LEAD, or half
+// of a shorter cadence. A refresh's result is current for the period
+// that starts this long after it.
+time_t refresh_lead(time_t cadence);
+
+// When the next refresh after now should run: a random moment in the
+// lead before the model update following the one now's lead reaches.
+// Always after now.
+time_t refresh_due_after(time_t now, time_t cadence, unsigned int* seed);
+
+#endif // REFRESH_H
@@ -0,0 +1,38 @@
+#ifndef SHM_CACHE_H
+#define SHM_CACHE_H
+
+#include <time.h>
+#include "weather.h"
+
+// Forecasts shared between concurrently running processes through a POSIX
+// shared-memory segment of fixed-size slots. Readers never lock; a process
+// that dies while writing leaves a slot others skip and later overwrite.
+
+#define SHM_CACHE_LEASE 10   // seconds a claim to fetch a key stays valid
+
+typedef struct ShmCache ShmCache;
+
+// Map the segment called name, creating it if needed; NULL on failure
+ShmCache* shm_cache_open(const char* name);
+void shm_cache_close(ShmCache* cache);
+
+// Remove the segment; mappings already open stay valid
+int shm_cache_unlink(const char* name);
+
+// A copy of the forecast stored for key, or NULL if absent or expired
+Forecast* shm_cache_get(ShmCache* cache, const char* key, time_t now);
+
+// Publish fc for key until expires. Forecasts with more days than a slot
+// holds are truncated.
+void shm_cache_put(ShmCache* cache, const char* key, const Forecast* fc, time_t expires);
+
+// Ask to be the one process fetching key. Returns 1 if the caller should
+// fetch and put the result, 0 if another process holds an unexpired
+// claim and the caller should poll shm_cache_get instead.
+int shm_cache_claim(ShmCache* cache, const char* key, time_t now);
+
+// Give up a claim whose fetch failed, so a waiting process can take over
+// at once instead of after SHM_CACHE_LEASE
+void shm_cache_release(ShmCache* cache, const char* key);
+
+#endif // SHM_CACHE_H
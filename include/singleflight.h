@@ -0,0 +1,32 @@
+#ifndef SINGLEFLIGHT_H
+#define SINGLEFLIGHT_H
+
+#include <pthread.h>
+
+// Request coalescing: concurrent calls with the same key share a single
+// execution of the work. The first caller (the leader) runs it; callers
+// that arrive while it is in flight wait and receive a copy of its result.
+
+struct FlightCall;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    struct FlightCall* calls;   // in-flight calls, one per key
+} FlightGroup;
+
+#define FLIGHT_GROUP_INIT { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL }
+
+// Produce the result for a key (may return NULL)
+typedef void* (*FlightFn)(void* arg);
+
+// Give a waiting caller its own copy of a non-NULL result
+typedef void* (*FlightCopyFn)(const void* result);
+
+// Run fn(arg) for key, or join the call already in flight for it. Every
+// caller owns what it gets back. If shared is non-NULL it is set to 1 when
+// the result came from another caller's call.
+void* flight_do(FlightGroup* group, const char* key, FlightFn fn, void* arg,
+                FlightCopyFn copy, int* shared);
+
+#endif // SINGLEFLIGHT_H
@@ -2,6 +2,7 @@
 #define WEATHER_H
 
 #include "core.h"
+#include <time.h>
 
 typedef struct {
     Latitude lat;
@@ -26,12 +27,32 @@ typedef struct {
 // Find location by city name
 Location* find_location(const char* city);
 
+// Location at the given coordinates, named after the nearest built-in
+// place; needs no network
+Location* find_nearest_location(Latitude lat, Longitude lon);
+
 // Get forecast for location
 Forecast* get_forecast(Location* location);
 
+// Fetch location's forecast into the caches ahead of the next model
+// update, bypassing entries due to expire by then; 0 on success. The
+// refresh scheduler's RefreshFn.
+int forecast_refresh(Location* location);
+
+// Seconds between model updates: WEATHER_MODEL_CADENCE, else
+// FORECAST_MODEL_CADENCE
+time_t forecast_cadence(void);
+
+// Free the forecast caches; the next call sets them up again from the
+// environment. Nothing else may be using them.
+void weather_cleanup(void);
+
 // Get weather description from code
 const char* get_weather_description(int code);
 
+// Deep copy, freed with forecast_free
+Forecast* forecast_copy(const Forecast* fc);
+
 // Free functions
 void location_free(Location* loc);
 void forecast_free(Forecast* fc);
@@ -27,3 +27,20 @@ void* malloc_safe(size_t size) {
     }
     return ptr;
 }
+
+size_t city_normalize(const char* city, char* out, size_t size) {
+    size_t len = 0;
+    int space = 0;
+    for (const unsigned char* p = (const unsigned char*)city; *p; p++) {
+        if (*p == ' ' || *p == '\t') {
+            space = len > 0;
+            continue;
+        }
+        if (len + space + 1 >= size) return 0;
+        if (space) out[len++] = ' ';
+        space = 0;
+        out[len++] = (char)(*p >= 'A' && *p <= 'Z' ? *p + 32 : *p);
+    }
+    out[len] = '\0';
+    return len;
+}
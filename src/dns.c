@@ -0,0 +1,135 @@
+#include "../include/dns.h"
+#include "../include/core.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <netinet/in.h>
+
+#define DNS_CACHE_SIZE 32
+
+typedef struct {
+    char* host;
+    DnsAddress addrs[DNS_MAX_ADDRS];
+    int count;
+    time_t expires;
+} DnsEntry;
+
+static DnsEntry cache[DNS_CACHE_SIZE];
+static pthread_rwlock_t cache_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static void set_port(DnsAddress* addr, int port) {
+    if (addr->addr.ss_family == AF_INET6) {
+        ((struct sockaddr_in6*)&addr->addr)->sin6_port = htons(port);
+    } else {
+        ((struct sockaddr_in*)&addr->addr)->sin_port = htons(port);
+    }
+}
+
+// Copy a cached entry for host into out; caller holds at least a read lock
+static int cache_lookup(const char* host, int port, DnsAddress* out, int max) {
+    time_t now = time(NULL);
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        DnsEntry* e = &cache[i];
+        if (!e->host || e->expires <= now || strcmp(e->host, host) != 0) continue;
+        
+        int n = e->count < max ? e->count : max;
+        for (int j = 0; j < n; j++) {
+            out[j] = e->addrs[j];
+            set_port(&out[j], port);
+        }
+        return n;
+    }
+    return 0;
+}
+
+static void cache_store(const char* host, const DnsAddress* addrs, int count) {
+    pthread_rwlock_wrlock(&cache_lock);
+    
+    // Reuse the host's old slot, else an empty one, else the soonest to expire
+    DnsEntry* slot = NULL;
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        DnsEntry* e = &cache[i];
+        if (e->host && strcmp(e->host, host) == 0) {
+            slot = e;
+            break;
+        }
+        if (!slot || (slot->host && (!e->host || e->expires < slot->expires))) slot = e;
+    }
+    
+    free(slot->host);
+    slot->host = strdup_safe(host);
+    memcpy(slot->addrs, addrs, count * sizeof(DnsAddress));
+    slot->count = count;
+    slot->expires = time(NULL) + DNS_CACHE_TTL;
+    
+    pthread_rwlock_unlock(&cache_lock);
+}
+
+int dns_resolve(const char* host, int port, DnsAddress* out, int max) {
+    pthread_rwlock_rdlock(&cache_lock);
+    int n = cache_lookup(host, port, out, max);
+    pthread_rwlock_unlock(&cache_lock);
+    if (n > 0) return n;
+    
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_ADDRCONFIG;
+    
+    struct addrinfo* res = NULL;
+    int rc = getaddrinfo(host, NULL, &hints, &res);
+    if (rc != 0) {
+        fprintf(stderr, "Failed to resolve %s: %s\n", host, gai_strerror(rc));
+        return 0;
+    }
+    
+    DnsAddress addrs[DNS_MAX_ADDRS];
+    int count = 0;
+    for (struct addrinfo* ai = res; ai && count < DNS_MAX_ADDRS; ai = ai->ai_next) {
+        if (ai->ai_family != AF_INET && ai->ai_family != AF_INET6) continue;
+        if (ai->ai_addrlen > sizeof(addrs[count].addr)) continue;
+        memset(&addrs[count], 0, sizeof(DnsAddress));
+        memcpy(&addrs[count].addr, ai->ai_addr, ai->ai_addrlen);
+        addrs[count].len = ai->ai_addrlen;
+        count++;
+    }
+    freeaddrinfo(res);
+    
+    if (count == 0) {
+        fprintf(stderr, "Failed to resolve %s: no usable addresses\n", host);
+        return 0;
+    }
+    
+    cache_store(host, addrs, count);
+    
+    n = count < max ? count : max;
+    for (int i = 0; i < n; i++) {
+        out[i] = addrs[i];
+        set_port(&out[i], port);
+    }
+    return n;
+}
+
+void dns_invalidate(const char* host) {
+    pthread_rwlock_wrlock(&cache_lock);
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        if (cache[i].host && strcmp(cache[i].host, host) == 0) {
+            free(cache[i].host);
+            cache[i].host = NULL;
+        }
+    }
+    pthread_rwlock_unlock(&cache_lock);
+}
+
+void dns_cache_clear(void) {
+    pthread_rwlock_wrlock(&cache_lock);
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        free(cache[i].host);
+        cache[i].host = NULL;
+    }
+    pthread_rwlock_unlock(&cache_lock);
+}
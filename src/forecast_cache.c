@@ -0,0 +1,167 @@
+#include "../include/forecast_cache.h"
+#include "../include/core.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define BUCKETS 64   // power of two
+
+typedef struct Entry {
+    char* key;
+    uint32_t hash;
+    Forecast* forecast;
+    size_t bytes;
+    time_t expires;
+    struct Entry* chain;              // next in the same bucket
+    struct Entry* newer;
+    struct Entry* older;
+} Entry;
+
+struct ForecastCache {
+    pthread_mutex_t lock;
+    Entry* buckets[BUCKETS];
+    Entry* newest;
+    Entry* oldest;
+    size_t bytes;
+    size_t budget;
+    time_t cadence;
+};
+
+static uint32_t hash_key(const char* key) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)key; *p; p++) {
+        h = (h ^ *p) * 16777619u;
+    }
+    return h;
+}
+
+// What an entry costs against the budget, allocations included
+static size_t entry_bytes(const char* key, const Forecast* fc) {
+    size_t bytes = sizeof(Entry) + strlen(key) + 1 + sizeof(Forecast) +
+                   strlen(fc->location.name) + 1 + strlen(fc->location.country) + 1 +
+                   fc->daily_count * sizeof(DailyForecast);
+    for (size_t i = 0; i < fc->daily_count; i++) {
+        bytes += strlen(fc->daily[i].date) + 1;
+    }
+    return bytes;
+}
+
+ForecastCache* forecast_cache_new(size_t budget, time_t cadence) {
+    ForecastCache* cache = malloc_safe(sizeof(ForecastCache));
+    memset(cache, 0, sizeof(*cache));
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->budget = budget;
+    cache->cadence = cadence > 0 ? cadence : FORECAST_MODEL_CADENCE;
+    return cache;
+}
+
+/* ---- Recency list ------------------------------------------------------- */
+
+static void list_unlink(ForecastCache* cache, Entry* e) {
+    if (e->newer) e->newer->older = e->older;
+    else cache->newest = e->older;
+    if (e->older) e->older->newer = e->newer;
+    else cache->oldest = e->newer;
+    e->newer = e->older = NULL;
+}
+
+static void list_push(ForecastCache* cache, Entry* e) {
+    e->older = cache->newest;
+    e->newer = NULL;
+    if (cache->newest) cache->newest->newer = e;
+    cache->newest = e;
+    if (!cache->oldest) cache->oldest = e;
+}
+
+static Entry* find(ForecastCache* cache, const char* key, uint32_t hash) {
+    for (Entry* e = cache->buckets[hash & (BUCKETS - 1)]; e; e = e->chain) {
+        if (e->hash == hash && strcmp(e->key, key) == 0) return e;
+    }
+    return NULL;
+}
+
+static void evict(ForecastCache* cache, Entry* e) {
+    Entry** link = &cache->buckets[e->hash & (BUCKETS - 1)];
+    while (*link != e) link = &(*link)->chain;
+    *link = e->chain;
+    list_unlink(cache, e);
+    cache->bytes -= e->bytes;
+    forecast_free(e->forecast);
+    free(e->key);
+    free(e);
+}
+
+static Forecast* lookup(ForecastCache* cache, const char* key, time_t now, int* stale) {
+    uint32_t hash = hash_key(key);
+    Forecast* fc = NULL;
+    
+    pthread_mutex_lock(&cache->lock);
+    Entry* e = find(cache, key, hash);
+    if (e && e->expires <= now && !stale) {
+        evict(cache, e);
+    } else if (e) {
+        list_unlink(cache, e);
+        list_push(cache, e);
+        fc = forecast_copy(e->forecast);
+        if (stale) *stale = e->expires <= now;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return fc;
+}
+
+Forecast* forecast_cache_get(ForecastCache* cache, const char* key, time_t now) {
+    return lookup(cache, key, now, NULL);
+}
+
+Forecast* forecast_cache_get_stale(ForecastCache* cache, const char* key, time_t now, int* stale) {
+    *stale = 0;
+    return lookup(cache, key, now, stale);
+}
+
+void forecast_cache_put(ForecastCache* cache, const char* key, const Forecast* fc, time_t now) {
+    size_t bytes = entry_bytes(key, fc);
+    if (bytes > cache->budget) return;
+    uint32_t hash = hash_key(key);
+    
+    Entry* e = malloc_safe(sizeof(Entry));
+    memset(e, 0, sizeof(*e));
+    e->key = strdup_safe(key);
+    e->hash = hash;
+    e->forecast = forecast_copy(fc);
+    e->bytes = bytes;
+    e->expires = forecast_cache_expiry(now, cache->cadence);
+    
+    pthread_mutex_lock(&cache->lock);
+    Entry* old = find(cache, key, hash);
+    if (old) evict(cache, old);
+    while (cache->oldest && cache->bytes + bytes > cache->budget) {
+        evict(cache, cache->oldest);
+    }
+    
+    Entry** bucket = &cache->buckets[hash & (BUCKETS - 1)];
+    e->chain = *bucket;
+    *bucket = e;
+    list_push(cache, e);
+    cache->bytes += bytes;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// Good until the next model run lands
+time_t forecast_cache_expiry(time_t now, time_t cadence) {
+    return (now / cadence + 1) * cadence;
+}
+
+size_t forecast_cache_size(ForecastCache* cache) {
+    pthread_mutex_lock(&cache->lock);
+    size_t bytes = cache->bytes;
+    pthread_mutex_unlock(&cache->lock);
+    return bytes;
+}
+
+void forecast_cache_free(ForecastCache* cache) {
+    if (!cache) return;
+    while (cache->oldest) evict(cache, cache->oldest);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
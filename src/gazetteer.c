@@ -0,0 +1,69 @@
+#include "../include/gazetteer.h"
+#include "../include/core.h"
+#include <string.h>
+#include <math.h>
+
+int gazetteer_lookup(const char* city, Location* out) {
+    char key[GAZETTEER_KEY_MAX];
+    if (gazetteer_count == 0 || !city_normalize(city, key, sizeof(key))) return 0;
+    
+    // Every key lands on its own entry; anything else lands on some
+    // entry too, so the name still has to match
+    uint32_t seed = gazetteer_displace[gazetteer_hash(key, 0) % gazetteer_bucket_count];
+    const GazetteerEntry* entry = &gazetteer_entries[gazetteer_hash(key, seed) % gazetteer_count];
+    if (strcmp(entry->key, key) != 0) return 0;
+    
+    out->lat.value = entry->lat;
+    out->lon.value = entry->lon;
+    out->name = strdup_safe(entry->name);
+    out->country = strdup_safe(entry->country);
+    return 1;
+}
+
+/* ---- Nearest place ------------------------------------------------------ */
+
+#define EARTH_RADIUS_KM 6371.0
+
+typedef struct {
+    double xyz[3];
+    const GazetteerPlace* best;
+    double best_d2;         // squared chord length to best
+} NearestSearch;
+
+static void search(NearestSearch* s, size_t lo, size_t hi) {
+    if (lo >= hi) return;
+    size_t mid = lo + (hi - lo) / 2;
+    const GazetteerPlace* place = &gazetteer_places[mid];
+    
+    double d2 = 0.0;
+    for (int a = 0; a < 3; a++) {
+        double d = s->xyz[a] - place->xyz[a];
+        d2 += d * d;
+    }
+    if (d2 < s->best_d2) {
+        s->best = place;
+        s->best_d2 = d2;
+    }
+    
+    // The near side first; the far side only if the splitting plane is
+    // closer than the best so far
+    double diff = s->xyz[place->axis] - place->xyz[place->axis];
+    if (diff < 0) {
+        search(s, lo, mid);
+        if (diff * diff < s->best_d2) search(s, mid + 1, hi);
+    } else {
+        search(s, mid + 1, hi);
+        if (diff * diff < s->best_d2) search(s, lo, mid);
+    }
+}
+
+const GazetteerPlace* gazetteer_nearest(double lat, double lon, double* km) {
+    double phi = lat * M_PI / 180.0;
+    double lambda = lon * M_PI / 180.0;
+    NearestSearch s = { { cos(phi) * cos(lambda), cos(phi) * sin(lambda), sin(phi) }, NULL, INFINITY };
+    search(&s, 0, gazetteer_place_count);
+    
+    // Chord length to central angle
+    if (s.best && km) *km = 2.0 * asin(fmin(sqrt(s.best_d2) / 2.0, 1.0)) * EARTH_RADIUS_KM;
+    return s.best;
+}
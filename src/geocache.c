@@ -0,0 +1,238 @@
+#include "../include/geocache.h"
+#include "../include/core.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define GEO_MAGIC "WXGEO001"
+#define GEO_SLOTS 8192               // power of two
+#define GEO_PROBE_LIMIT 16
+#define GEO_KEY_MAX 64
+#define GEO_NAME_MAX 64
+#define GEO_COUNTRY_MAX 64
+#define GEO_NEGATIVE_TTL (24 * 60 * 60)
+#define GEO_READ_RETRIES 64
+
+enum { SLOT_EMPTY, SLOT_FOUND, SLOT_NOT_FOUND };
+
+typedef struct {
+    char magic[8];
+    uint32_t slot_size;              // guards against layout changes
+    uint32_t slot_count;
+} GeoHeader;
+
+// seq is odd while a writer is inside the slot
+typedef struct {
+    _Atomic uint32_t seq;
+    uint32_t hash;
+    uint32_t state;
+    uint32_t reserved;
+    int64_t stored_at;
+    double lat;
+    double lon;
+    char key[GEO_KEY_MAX];
+    char name[GEO_NAME_MAX];
+    char country[GEO_COUNTRY_MAX];
+} GeoSlot;
+
+struct GeoCache {
+    int fd;
+    void* map;
+    size_t map_len;
+    GeoSlot* slots;
+    pthread_mutex_t write_lock;      // flock doesn't exclude threads sharing fd
+};
+
+#define GEO_FILE_SIZE (sizeof(GeoSlot) * (GEO_SLOTS + 1))
+
+static uint32_t hash_city(const char* key) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)key; *p; p++) {
+        h = (h ^ *p) * 16777619u;
+    }
+    return h;
+}
+
+static int header_valid(const GeoHeader* header) {
+    return memcmp(header->magic, GEO_MAGIC, sizeof(header->magic)) == 0 &&
+           header->slot_size == sizeof(GeoSlot) && header->slot_count == GEO_SLOTS;
+}
+
+GeoCache* geocache_open(const char* path) {
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return NULL;
+    
+    // Whoever gets here first lays the file out
+    flock(fd, LOCK_EX);
+    struct stat st;
+    GeoHeader header;
+    int ok = fstat(fd, &st) == 0;
+    if (ok && ((size_t)st.st_size != GEO_FILE_SIZE ||
+               pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+               !header_valid(&header))) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, GEO_MAGIC, sizeof(header.magic));
+        header.slot_size = sizeof(GeoSlot);
+        header.slot_count = GEO_SLOTS;
+        ok = ftruncate(fd, 0) == 0 && ftruncate(fd, GEO_FILE_SIZE) == 0 &&
+             pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header);
+    }
+    flock(fd, LOCK_UN);
+    
+    void* map = ok ? mmap(NULL, GEO_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (map == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    
+    GeoCache* cache = malloc_safe(sizeof(GeoCache));
+    cache->fd = fd;
+    cache->map = map;
+    cache->map_len = GEO_FILE_SIZE;
+    cache->slots = (GeoSlot*)map + 1;    // slot 0's space holds the header
+    pthread_mutex_init(&cache->write_lock, NULL);
+    return cache;
+}
+
+void geocache_close(GeoCache* cache) {
+    if (!cache) return;
+    munmap(cache->map, cache->map_len);
+    close(cache->fd);
+    pthread_mutex_destroy(&cache->write_lock);
+    free(cache);
+}
+
+// Consistent copy of a slot; 0 if writers kept it busy
+static int slot_read(GeoSlot* slot, GeoSlot* copy) {
+    for (int attempt = 0; attempt < GEO_READ_RETRIES; attempt++) {
+        uint32_t before = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (before & 1) continue;
+        memcpy((char*)copy + sizeof(copy->seq), (char*)slot + sizeof(slot->seq),
+               sizeof(GeoSlot) - sizeof(slot->seq));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == before) return 1;
+    }
+    return 0;
+}
+
+GeoCacheResult geocache_lookup(GeoCache* cache, const char* city, Location* out) {
+    char key[GEO_KEY_MAX];
+    if (!cache || !city_normalize(city, key, sizeof(key))) return GEOCACHE_MISS;
+    uint32_t hash = hash_city(key);
+    
+    for (uint32_t i = 0; i < GEO_PROBE_LIMIT; i++) {
+        GeoSlot copy;
+        if (!slot_read(&cache->slots[(hash + i) & (GEO_SLOTS - 1)], &copy)) continue;
+        if (copy.state == SLOT_EMPTY) break;
+        if (copy.hash != hash || strncmp(copy.key, key, GEO_KEY_MAX) != 0) continue;
+        
+        if (copy.state == SLOT_NOT_FOUND) {
+            if (time(NULL) - copy.stored_at > GEO_NEGATIVE_TTL) return GEOCACHE_MISS;
+            return GEOCACHE_NOT_FOUND;
+        }
+        copy.name[GEO_NAME_MAX - 1] = '\0';
+        copy.country[GEO_COUNTRY_MAX - 1] = '\0';
+        out->lat.value = copy.lat;
+        out->lon.value = copy.lon;
+        out->name = strdup_safe(copy.name);
+        out->country = strdup_safe(copy.country);
+        return GEOCACHE_FOUND;
+    }
+    return GEOCACHE_MISS;
+}
+
+void geocache_store(GeoCache* cache, const char* city, const Location* loc) {
+    char key[GEO_KEY_MAX];
+    if (!cache || !city_normalize(city, key, sizeof(key))) return;
+    if (loc && (strlen(loc->name) >= GEO_NAME_MAX || strlen(loc->country) >= GEO_COUNTRY_MAX)) return;
+    uint32_t hash = hash_city(key);
+    
+    pthread_mutex_lock(&cache->write_lock);
+    flock(cache->fd, LOCK_EX);
+    
+    // The slot already holding the city, else the first empty one, else
+    // the oldest entry in the probe window
+    GeoSlot* target = NULL;
+    GeoSlot* oldest = NULL;
+    for (uint32_t i = 0; i < GEO_PROBE_LIMIT && !target; i++) {
+        GeoSlot* slot = &cache->slots[(hash + i) & (GEO_SLOTS - 1)];
+        if (slot->state == SLOT_EMPTY ||
+            (slot->hash == hash && strncmp(slot->key, key, GEO_KEY_MAX) == 0)) {
+            target = slot;
+        } else if (!oldest || slot->stored_at < oldest->stored_at) {
+            oldest = slot;
+        }
+    }
+    if (!target) target = oldest;
+    
+    // A writer that died inside the slot left seq odd; just carry on
+    uint32_t seq = atomic_load_explicit(&target->seq, memory_order_relaxed) | 1;
+    atomic_store_explicit(&target->seq, seq, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    
+    target->hash = hash;
+    target->stored_at = time(NULL);
+    memset(target->key, 0, sizeof(target->key));
+    memset(target->name, 0, sizeof(target->name));
+    memset(target->country, 0, sizeof(target->country));
+    strcpy(target->key, key);
+    if (loc) {
+        target->lat = loc->lat.value;
+        target->lon = loc->lon.value;
+        strcpy(target->name, loc->name);
+        strcpy(target->country, loc->country);
+    }
+    target->state = loc ? SLOT_FOUND : SLOT_NOT_FOUND;
+    
+    atomic_store_explicit(&target->seq, seq + 1, memory_order_release);
+    flock(cache->fd, LOCK_UN);
+    pthread_mutex_unlock(&cache->write_lock);
+}
+
+/* ---- Default cache ------------------------------------------------------ */
+
+static GeoCache* default_cache;
+static pthread_once_t default_once = PTHREAD_ONCE_INIT;
+
+static void default_open(void) {
+    const char* env = getenv("WEATHER_GEOCACHE");
+    if (env) {
+        if (*env) default_cache = geocache_open(env);
+        return;
+    }
+    
+    char dir[512];
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    if (xdg && *xdg) {
+        snprintf(dir, sizeof(dir), "%s", xdg);
+    } else if (home && *home) {
+        snprintf(dir, sizeof(dir), "%s/.cache", home);
+        mkdir(dir, 0755);
+    } else {
+        return;
+    }
+    
+    size_t len = strlen(dir);
+    snprintf(dir + len, sizeof(dir) - len, "/weather-c");
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST) return;
+    
+    len = strlen(dir);
+    snprintf(dir + len, sizeof(dir) - len, "/geocache.bin");
+    default_cache = geocache_open(dir);
+}
+
+GeoCache* geocache_default(void) {
+    pthread_once(&default_once, default_open);
+    return default_cache;
+}
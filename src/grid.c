@@ -0,0 +1,95 @@
+#include "../include/grid.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static const char geohash_alphabet[] = "0123456789bcdefghjkmnpqrstuvwxyz";
+
+int grid_parse(const char* text, GridSpec* spec) {
+    spec->kind = GRID_NONE;
+    spec->step = 0.0;
+    spec->precision = 0;
+    if (strcmp(text, "none") == 0 || *text == '\0') return 0;
+    
+    char* end;
+    if (strncmp(text, "geohash:", 8) == 0) {
+        long precision = strtol(text + 8, &end, 10);
+        if (end == text + 8 || *end != '\0' || precision < 1 || precision > GEOHASH_MAX) return -1;
+        spec->kind = GRID_GEOHASH;
+        spec->precision = (int)precision;
+        return 0;
+    }
+    
+    double step = strtod(text, &end);
+    if (end == text || *end != '\0' || !(step > 0.0 && step <= 90.0)) return -1;
+    spec->kind = GRID_DEGREES;
+    spec->step = step;
+    return 0;
+}
+
+// Bits alternate longitude, latitude, longitude, ... five to a character
+static void geohash_bounds(double lat, double lon, int precision, char* out,
+                           double lat_range[2], double lon_range[2]) {
+    lat_range[0] = -90.0;
+    lat_range[1] = 90.0;
+    lon_range[0] = -180.0;
+    lon_range[1] = 180.0;
+    int even = 1;
+    
+    for (int i = 0; i < precision; i++) {
+        int index = 0;
+        for (int bit = 0; bit < 5; bit++) {
+            double* range = even ? lon_range : lat_range;
+            double value = even ? lon : lat;
+            double mid = (range[0] + range[1]) / 2.0;
+            index <<= 1;
+            if (value >= mid) {
+                index |= 1;
+                range[0] = mid;
+            } else {
+                range[1] = mid;
+            }
+            even = !even;
+        }
+        out[i] = geohash_alphabet[index];
+    }
+    out[precision] = '\0';
+}
+
+void geohash_encode(double lat, double lon, int precision, char* out) {
+    double lat_range[2], lon_range[2];
+    geohash_bounds(lat, lon, precision, out, lat_range, lon_range);
+}
+
+void grid_snap(const GridSpec* spec, double lat, double lon,
+               char key[GRID_KEY_MAX], double* cell_lat, double* cell_lon) {
+    switch (spec->kind) {
+        case GRID_DEGREES: {
+            // One cell for 180 and -180
+            if (lon >= 180.0) lon -= 360.0;
+            double row = floor((lat + 90.0) / spec->step);
+            double col = floor((lon + 180.0) / spec->step);
+            *cell_lat = fmin(-90.0 + (row + 0.5) * spec->step, 90.0);
+            *cell_lon = fmin(-180.0 + (col + 0.5) * spec->step, 180.0);
+            snprintf(key, GRID_KEY_MAX, "g%g:%.0f,%.0f", spec->step, row, col);
+            return;
+        }
+        case GRID_GEOHASH: {
+            char hash[GEOHASH_MAX + 1];
+            double lat_range[2], lon_range[2];
+            geohash_bounds(lat, lon, spec->precision, hash, lat_range, lon_range);
+            *cell_lat = (lat_range[0] + lat_range[1]) / 2.0;
+            *cell_lon = (lon_range[0] + lon_range[1]) / 2.0;
+            snprintf(key, GRID_KEY_MAX, "h:%s", hash);
+            return;
+        }
+        case GRID_NONE:
+        default:
+            *cell_lat = lat;
+            *cell_lon = lon;
+            // Same precision as the request URL: a key per distinct request
+            snprintf(key, GRID_KEY_MAX, "%.4f,%.4f", lat, lon);
+            return;
+    }
+}
@@ -1,12 +1,25 @@
 #include "../include/http.h"
 #include "../include/core.h"
+#include "../include/dns.h"
+#include "../include/inflate.h"
+#include "../include/singleflight.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <stdint.h>
 #include <unistd.h>
-#include <netdb.h>
+#include <poll.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <fcntl.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <arpa/inet.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
 #include <ctype.h>
 
 static int str_contains_case_insensitive(const char* haystack, const char* needle) {
@@ -29,14 +42,135 @@ static int str_contains_case_insensitive(const char* haystack, const char* needl
 }
 
 #define BUFFER_SIZE 65536
+#define HEAD_BUFFER_SIZE 16384
+
+// Idle keep-alive connections, shared by every request to the same host:port
+#define POOL_SIZE 8
+#define POOL_IDLE_TIMEOUT 30 // seconds
+
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+typedef struct {
+    char* host;
+    int port;
+    int fd;
+    time_t last_used;
+} PooledConn;
+
+static PooledConn pool[POOL_SIZE];
+static int pool_initialized = 0;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void pool_init(void) {
+    if (pool_initialized) return;
+    for (int i = 0; i < POOL_SIZE; i++) {
+        pool[i].host = NULL;
+        pool[i].fd = -1;
+    }
+    pool_initialized = 1;
+}
+
+static void pool_drop(PooledConn* conn) {
+    close(conn->fd);
+    free(conn->host);
+    conn->host = NULL;
+    conn->fd = -1;
+}
+
+static void set_nonblocking(int fd, int on) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return;
+    fcntl(fd, F_SETFL, on ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK));
+}
+
+// An idle socket must have nothing to read: readable means the server
+// either closed it (EOF) or sent something we never asked for.
+static int connection_alive(int fd) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    int rc = poll(&pfd, 1, 0);
+    if (rc < 0) return 0;
+    if (rc == 0) return 1;
+    if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) return 0;
+    
+    char c;
+    ssize_t n = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 1;
+    return 0;
+}
+
+// Take an idle connection to host:port out of the pool, or -1 if none
+static int pool_acquire(const char* host, int port) {
+    pthread_mutex_lock(&pool_lock);
+    pool_init();
+    time_t now = time(NULL);
+    int found = -1;
+    
+    for (int i = 0; i < POOL_SIZE; i++) {
+        PooledConn* conn = &pool[i];
+        if (conn->fd < 0) continue;
+        
+        if (now - conn->last_used > POOL_IDLE_TIMEOUT || !connection_alive(conn->fd)) {
+            pool_drop(conn);
+            continue;
+        }
+        
+        if (conn->port == port && strcmp(conn->host, host) == 0) {
+            found = conn->fd;
+            free(conn->host);
+            conn->host = NULL;
+            conn->fd = -1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool_lock);
+    return found;
+}
+
+// Hand a connection back for reuse, evicting the oldest idle one if full
+static void pool_release(const char* host, int port, int fd) {
+    pthread_mutex_lock(&pool_lock);
+    pool_init();
+    PooledConn* slot = NULL;
+    
+    for (int i = 0; i < POOL_SIZE; i++) {
+        if (pool[i].fd < 0) {
+            slot = &pool[i];
+            break;
+        }
+        if (!slot || pool[i].last_used < slot->last_used) {
+            slot = &pool[i];
+        }
+    }
+    
+    if (slot->fd >= 0) pool_drop(slot);
+    slot->host = strdup_safe(host);
+    slot->port = port;
+    slot->fd = fd;
+    slot->last_used = time(NULL);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+void http_cleanup(void) {
+    pthread_mutex_lock(&pool_lock);
+    if (pool_initialized) {
+        for (int i = 0; i < POOL_SIZE; i++) {
+            if (pool[i].fd >= 0) pool_drop(&pool[i]);
+        }
+    }
+    pthread_mutex_unlock(&pool_lock);
+}
 
 static int parse_url(const char* url, char** host, char** path, int* port) {
     const char* start = url;
     
     // Skip http://
-    if (strncmp(start, "http://", 7) == 0) {
+    if (strncasecmp(start, "http://", 7) == 0) {
         start += 7;
-    } else if (strncmp(start, "https://", 8) == 0) {
+    } else if (strncasecmp(start, "https://", 8) == 0) {
         fprintf(stderr, "HTTPS not supported\n");
         return -1;
     }
@@ -46,12 +180,12 @@ static int parse_url(const char* url, char** host, char** path, int* port) {
     const char* colon = strchr(start, ':');
     
     // Extract host and port
-    int host_len;
+    size_t host_len;
     if (colon && (!slash || colon < slash)) {
         host_len = colon - start;
         *port = atoi(colon + 1);
     } else {
-        host_len = slash ? (slash - start) : strlen(start);
+        host_len = slash ? (size_t)(slash - start) : strlen(start);
         *port = 80;
     }
     
@@ -69,139 +203,1439 @@ static int parse_url(const char* url, char** host, char** path, int* port) {
     return 0;
 }
 
-static char* decode_chunked(const char* body) {
-    size_t total_size = 0;
-    char* result = malloc_safe(1);
-    result[0] = '\0';
+// Create a socket and connect it to one resolved address. With nonblocking
+// set the connect may still be in progress when this returns.
+static int connect_address(const DnsAddress* addr, int nonblocking) {
+    int sockfd = socket(addr->addr.ss_family, SOCK_STREAM, 0);
+    if (sockfd < 0) return -1;
     
-    const char* p = body;
-    while (*p) {
-        // Read chunk size
-        char* end;
-        long chunk_size = strtol(p, &end, 16);
-        if (p == end) break;
-        
-        p = end;
-        if (*p == '\r') p++;
-        if (*p == '\n') p++;
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    
+    if (nonblocking) set_nonblocking(sockfd, 1);
+    
+    if (connect(sockfd, (const struct sockaddr*)&addr->addr, addr->len) < 0 &&
+        !(nonblocking && errno == EINPROGRESS)) {
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+static long long now_ms(void);
+
+// Wait up to timeout_ms (-1: no limit) for a nonblocking connect on fd
+// to finish; 0 once it has connected
+static int await_connect(int fd, int timeout_ms) {
+    struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+    int rc;
+    do {
+        rc = poll(&pfd, 1, timeout_ms);
+    } while (rc < 0 && errno == EINTR);
+    if (rc <= 0) return -1;
+    
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) return -1;
+    return 0;
+}
+
+// Connect to host:port, falling through its addresses until one accepts.
+// Like the batch path, every address shares one timeout_ms budget (0: none).
+static int open_connection(const char* host, int port, int timeout_ms) {
+    DnsAddress addrs[DNS_MAX_ADDRS];
+    int count = dns_resolve(host, port, addrs, DNS_MAX_ADDRS);
+    long long deadline = timeout_ms > 0 ? now_ms() + timeout_ms : 0;
+    
+    for (int i = 0; i < count; i++) {
+        int wait = -1;
+        if (deadline) {
+            long long left = deadline - now_ms();
+            if (left <= 0) break;
+            wait = (int)left;
+        }
+        int sockfd = connect_address(&addrs[i], 1);
+        if (sockfd < 0) continue;
+        if (await_connect(sockfd, wait) == 0) {
+            set_nonblocking(sockfd, 0);
+            return sockfd;
+        }
+        close(sockfd);
+    }
+    
+    if (count > 0) {
+        fprintf(stderr, "Failed to connect to %s\n", host);
+        dns_invalidate(host);
+    }
+    return -1;
+}
+
+static int send_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, SEND_FLAGS);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Find a header value (case-insensitive name match) in a NUL-terminated header block
+static const char* find_header(const char* headers, const char* name) {
+    size_t name_len = strlen(name);
+    const char* line = strstr(headers, "\r\n");
+    
+    while (line) {
+        line += 2;
+        if (strncasecmp(line, name, name_len) == 0 && line[name_len] == ':') {
+            const char* value = line + name_len + 1;
+            while (*value == ' ' || *value == '\t') value++;
+            return value;
+        }
+        line = strstr(line, "\r\n");
+    }
+    return NULL;
+}
+
+// Chunked transfer decoding runs as bytes come off the socket and compacts
+// the payload in place: decoded data never outgrows the raw bytes it came
+// from, so it can be written over them in the same buffer.
+typedef enum {
+    CHUNK_SIZE,          // hex digits of the chunk size
+    CHUNK_EXT,           // ";name=value" extensions up to the end of line
+    CHUNK_SIZE_LF,
+    CHUNK_DATA,
+    CHUNK_DATA_CR,
+    CHUNK_DATA_LF,
+    CHUNK_TRAILER,       // start of a trailer line (or the final blank line)
+    CHUNK_TRAILER_LINE,
+    CHUNK_TRAILER_LF,
+    CHUNK_DONE,
+    CHUNK_ERROR
+} ChunkState;
+
+typedef struct {
+    ChunkState state;
+    size_t remaining;    // payload bytes left in the current chunk / size being parsed
+    int digits;
+} ChunkDecoder;
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Decode raw bytes buf[in, in_end) in place, appending payload at
+// buf[*out]. Returns the number of raw bytes consumed, which is short of
+// in_end - in only when the message ended (or was malformed) early.
+static size_t chunk_decode(ChunkDecoder* d, char* buf, size_t* out, size_t in, size_t in_end) {
+    size_t start = in;
+    
+    while (in < in_end && d->state != CHUNK_DONE && d->state != CHUNK_ERROR) {
+        char c = buf[in];
         
-        if (chunk_size == 0) break;
+        switch (d->state) {
+            case CHUNK_SIZE: {
+                int v = hex_value(c);
+                if (v >= 0) {
+                    if (d->remaining > ((size_t)-1 >> 4)) {
+                        d->state = CHUNK_ERROR;
+                        break;
+                    }
+                    d->remaining = d->remaining * 16 + v;
+                    d->digits++;
+                } else if (d->digits == 0) {
+                    d->state = CHUNK_ERROR;
+                } else if (c == ';' || c == ' ' || c == '\t') {
+                    d->state = CHUNK_EXT;
+                } else if (c == '\r') {
+                    d->state = CHUNK_SIZE_LF;
+                } else if (c == '\n') {
+                    d->state = d->remaining ? CHUNK_DATA : CHUNK_TRAILER;
+                } else {
+                    d->state = CHUNK_ERROR;
+                }
+                in++;
+                break;
+            }
+            case CHUNK_EXT:
+                if (c == '\r') d->state = CHUNK_SIZE_LF;
+                else if (c == '\n') d->state = d->remaining ? CHUNK_DATA : CHUNK_TRAILER;
+                in++;
+                break;
+            case CHUNK_SIZE_LF:
+                if (c != '\n') {
+                    d->state = CHUNK_ERROR;
+                    break;
+                }
+                d->state = d->remaining ? CHUNK_DATA : CHUNK_TRAILER;
+                in++;
+                break;
+            case CHUNK_DATA: {
+                size_t n = in_end - in;
+                if (n > d->remaining) n = d->remaining;
+                if (*out != in) memmove(buf + *out, buf + in, n);
+                *out += n;
+                in += n;
+                d->remaining -= n;
+                if (d->remaining == 0) d->state = CHUNK_DATA_CR;
+                break;
+            }
+            case CHUNK_DATA_CR:
+            case CHUNK_DATA_LF:
+                if (c == '\r' && d->state == CHUNK_DATA_CR) {
+                    d->state = CHUNK_DATA_LF;
+                } else if (c == '\n') {
+                    d->state = CHUNK_SIZE;
+                    d->digits = 0;
+                } else {
+                    d->state = CHUNK_ERROR;
+                    break;
+                }
+                in++;
+                break;
+            case CHUNK_TRAILER:
+                if (c == '\r') d->state = CHUNK_TRAILER_LF;
+                else if (c == '\n') d->state = CHUNK_DONE;
+                else d->state = CHUNK_TRAILER_LINE;
+                in++;
+                break;
+            case CHUNK_TRAILER_LINE:
+                if (c == '\n') d->state = CHUNK_TRAILER;
+                in++;
+                break;
+            case CHUNK_TRAILER_LF:
+                if (c != '\n') {
+                    d->state = CHUNK_ERROR;
+                    break;
+                }
+                d->state = CHUNK_DONE;
+                in++;
+                break;
+            default:
+                break;
+        }
+    }
+    
+    return in - start;
+}
+
+// Scratch buffers for response heads are recycled across requests instead
+// of going back to malloc each time
+#define BUFFER_POOL_SIZE 8
+#define BUFFER_POOL_MAX (4 * 1024 * 1024) // bigger buffers are not worth keeping
+
+typedef struct {
+    char* data;
+    size_t capacity;
+} PooledBuffer;
+
+static PooledBuffer buffer_pool[BUFFER_POOL_SIZE];
+static size_t buffer_pool_count = 0;
+static pthread_mutex_t buffer_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Best-fitting pooled buffer of at least min_size bytes, or a fresh one
+static char* buffer_acquire(size_t min_size, size_t* capacity) {
+    pthread_mutex_lock(&buffer_pool_lock);
+    size_t best = buffer_pool_count;
+    for (size_t i = 0; i < buffer_pool_count; i++) {
+        if (buffer_pool[i].capacity < min_size) continue;
+        if (best == buffer_pool_count || buffer_pool[i].capacity < buffer_pool[best].capacity) {
+            best = i;
+        }
+    }
+    
+    if (best == buffer_pool_count) {
+        pthread_mutex_unlock(&buffer_pool_lock);
+        *capacity = min_size;
+        return malloc_safe(min_size);
+    }
+    
+    char* data = buffer_pool[best].data;
+    *capacity = buffer_pool[best].capacity;
+    buffer_pool[best] = buffer_pool[--buffer_pool_count];
+    pthread_mutex_unlock(&buffer_pool_lock);
+    return data;
+}
+
+static void buffer_release(char* data, size_t capacity) {
+    if (!data) return;
+    if (capacity > BUFFER_POOL_MAX) {
+        free(data);
+        return;
+    }
+    
+    pthread_mutex_lock(&buffer_pool_lock);
+    if (buffer_pool_count < BUFFER_POOL_SIZE) {
+        buffer_pool[buffer_pool_count].data = data;
+        buffer_pool[buffer_pool_count].capacity = capacity;
+        buffer_pool_count++;
+        pthread_mutex_unlock(&buffer_pool_lock);
+        return;
+    }
+    
+    // Pool is full: keep the larger of this buffer and the smallest pooled one
+    size_t smallest = 0;
+    for (size_t i = 1; i < BUFFER_POOL_SIZE; i++) {
+        if (buffer_pool[i].capacity < buffer_pool[smallest].capacity) smallest = i;
+    }
+    char* evicted = data;
+    if (buffer_pool[smallest].capacity < capacity) {
+        evicted = buffer_pool[smallest].data;
+        buffer_pool[smallest].data = data;
+        buffer_pool[smallest].capacity = capacity;
+    }
+    pthread_mutex_unlock(&buffer_pool_lock);
+    free(evicted);
+}
+
+typedef struct {
+    char* head;            // pooled buffer holding the status line and headers
+    size_t head_len;
+    size_t head_cap;
+    size_t header_len;     // bytes up to and including the blank line, 0 until seen
+    char* body;
+    size_t body_len;
+    size_t body_cap;
+    int body_pooled;       // body is a scratch buffer from the buffer pool
+    HttpBodyFn sink;       // if set, a 200 body is handed over as it arrives
+    void* sink_data;
+    int status;
+    long content_length;   // -1 when the server did not send one
+    int chunked;
+    ChunkDecoder chunks;
+    int encoding;          // CONTENT_IDENTITY or an InflateFormat
+    Inflater* inflater;    // set while a compressed body is streaming in
+    size_t received;       // raw body bytes read off the socket
+    int keep_alive;
+    const char* preload;   // bytes already read from the socket, used before read()
+    size_t preload_len;
+    char* spill;           // bytes read past the end of this message
+    size_t spill_len;
+} HttpResponse;
+
+#define CONTENT_IDENTITY -1
+
+#define READ_OK       0
+#define READ_ERROR   -1
+#define READ_CLOSED  -2  // connection closed or reset before any byte arrived
+#define READ_PENDING -3  // non-blocking socket has no more data for now
+
+// Copy a header's value (up to the end of its line) into buf; 0 if absent
+static int header_value(const char* headers, const char* name, char* buf, size_t size) {
+    const char* value = find_header(headers, name);
+    if (!value) return 0;
+    
+    const char* end = strstr(value, "\r\n");
+    size_t n = end ? (size_t)(end - value) : strlen(value);
+    while (n > 0 && (value[n - 1] == ' ' || value[n - 1] == '\t')) n--;
+    if (n >= size) n = size - 1;
+    memcpy(buf, value, n);
+    buf[n] = '\0';
+    return 1;
+}
+
+// Parse status line and framing headers once the header block is complete
+static int parse_headers(HttpResponse* resp) {
+    char* headers = resp->head;
+    headers[resp->header_len - 2] = '\0';
+    
+    if (strncmp(headers, "HTTP/1.", 7) != 0) return -1;
+    resp->status = atoi(headers + 9);
+    
+    const char* connection = find_header(headers, "Connection");
+    if (headers[7] == '0') {
+        resp->keep_alive = connection && strncasecmp(connection, "keep-alive", 10) == 0;
+    } else {
+        resp->keep_alive = !(connection && strncasecmp(connection, "close", 5) == 0);
+    }
+    
+    char value[64];
+    if (header_value(headers, "Transfer-Encoding", value, sizeof(value))) {
+        resp->chunked = str_contains_case_insensitive(value, "chunked");
+    }
+    
+    resp->encoding = CONTENT_IDENTITY;
+    if (header_value(headers, "Content-Encoding", value, sizeof(value))) {
+        if (str_contains_case_insensitive(value, "gzip")) {
+            resp->encoding = INFLATE_GZIP;
+        } else if (str_contains_case_insensitive(value, "deflate")) {
+            // Servers disagree on whether "deflate" means zlib-wrapped or raw
+            resp->encoding = INFLATE_AUTO;
+        } else if (strcasecmp(value, "identity") != 0) {
+            return -1;
+        }
+    }
+    
+    const char* cl = find_header(headers, "Content-Length");
+    resp->content_length = cl ? strtol(cl, NULL, 10) : -1;
+    if (resp->chunked) resp->content_length = -1;
+    
+    // Responses that never carry a body
+    if (resp->status == 204 || resp->status == 304 || resp->status / 100 == 1) {
+        resp->content_length = 0;
+        resp->chunked = 0;
+    }
+    
+    // Without framing, the body runs until EOF and the socket can't be reused
+    if (!resp->chunked && resp->content_length < 0) resp->keep_alive = 0;
+    return 0;
+}
+
+// Look for the blank line ending the headers, scanning only bytes that
+// arrived since the last call (plus three for a split terminator)
+static int find_header_end(HttpResponse* resp, size_t new_bytes) {
+    size_t from = resp->head_len - new_bytes;
+    from = from > 3 ? from - 3 : 0;
+    
+    const char* p = resp->head + from;
+    const char* end = resp->head + resp->head_len;
+    while ((p = memchr(p, '\r', end - p)) != NULL && end - p >= 4) {
+        if (p[1] == '\n' && p[2] == '\r' && p[3] == '\n') {
+            resp->header_len = p + 4 - resp->head;
+            return 1;
+        }
+        p++;
+    }
+    return 0;
+}
+
+// Keep bytes that arrived after the end of this message. On a pipelined
+// connection they are the start of the next response.
+static void response_spill(HttpResponse* resp, const char* data, size_t len) {
+    if (len == 0) return;
+    resp->spill = realloc(resp->spill, resp->spill_len + len);
+    if (!resp->spill) {
+        fprintf(stderr, "Fatal: realloc failed\n");
+        exit(1);
+    }
+    memcpy(resp->spill + resp->spill_len, data, len);
+    resp->spill_len += len;
+}
+
+// Account for n raw bytes just read into body[body_len...]: dechunk them in
+// place and, for compressed bodies, stream the payload into the inflater so
+// the receive buffer can be reused.
+static int body_consume(HttpResponse* resp, size_t n) {
+    resp->received += n;
+    
+    if (resp->chunked) {
+        size_t from = resp->body_len;
+        size_t used = chunk_decode(&resp->chunks, resp->body, &resp->body_len, from, from + n);
+        if (resp->chunks.state == CHUNK_ERROR) return -1;
+        // The decoder leaves bytes past the terminator untouched
+        response_spill(resp, resp->body + from + used, n - used);
+    } else {
+        resp->body_len += n;
+    }
+    
+    if (resp->inflater && resp->body_len > 0) {
+        InflateStatus st = inflater_feed(resp->inflater, (unsigned char*)resp->body, resp->body_len);
+        if (st == INFLATE_ERROR) return -1;
+        resp->body_len = 0;
+        if (resp->sink) {
+            size_t len;
+            const char* data = inflater_drain(resp->inflater, &len);
+            if (len > 0 && resp->sink(data, len, resp->sink_data) != 0) return -1;
+        }
+    } else if (resp->sink && resp->body_len > 0) {
+        if (resp->sink(resp->body, resp->body_len, resp->sink_data) != 0) return -1;
+        resp->body_len = 0;
+    }
+    return 0;
+}
+
+// Allocate the body buffer once headers are known and move in any body
+// bytes that arrived together with the headers
+static int body_start(HttpResponse* resp) {
+    size_t surplus = resp->head_len - resp->header_len;
+    if (resp->content_length >= 0 && surplus > (size_t)resp->content_length) {
+        response_spill(resp, resp->head + resp->header_len + resp->content_length,
+                       surplus - resp->content_length);
+        surplus = resp->content_length;
+    }
+    
+    // Error bodies are kept for the caller rather than streamed
+    if (resp->status != 200) resp->sink = NULL;
+    
+    if (resp->encoding != CONTENT_IDENTITY && resp->content_length != 0) {
+        // Compressed data only passes through; the inflater owns the result
+        resp->inflater = inflater_new((InflateFormat)resp->encoding);
+    }
+    
+    if (resp->inflater || resp->sink) {
+        resp->body = buffer_acquire(surplus + 1 > BUFFER_SIZE ? surplus + 1 : BUFFER_SIZE,
+                                    &resp->body_cap);
+        resp->body_pooled = 1;
+    } else if (resp->content_length >= 0) {
+        // Exact size: this buffer is handed to the caller as is
+        resp->body_cap = (size_t)resp->content_length + 1;
+        resp->body = malloc_safe(resp->body_cap);
+    } else {
+        resp->body_cap = surplus + 1 > BUFFER_SIZE ? surplus + 1 : BUFFER_SIZE;
+        resp->body = malloc_safe(resp->body_cap);
+    }
+    
+    memcpy(resp->body, resp->head + resp->header_len, surplus);
+    resp->body_len = 0;
+    return body_consume(resp, surplus);
+}
+
+// Make room for at least one more byte (plus NUL) in a body of unknown length
+static void body_reserve(HttpResponse* resp) {
+    if (resp->body_len + 1 < resp->body_cap) return;
+    
+    size_t new_cap = resp->body_cap * 2;
+    resp->body = realloc(resp->body, new_cap);
+    if (!resp->body) {
+        fprintf(stderr, "Fatal: realloc failed\n");
+        exit(1);
+    }
+    resp->body_cap = new_cap;
+}
+
+// Has the whole message (headers + framed body) arrived?
+static int response_complete(HttpResponse* resp, int eof) {
+    if (!resp->header_len) return 0;
+    if (resp->chunked) return resp->chunks.state == CHUNK_DONE;
+    if (resp->content_length >= 0) return resp->received >= (size_t)resp->content_length;
+    return eof;
+}
+
+// Wrap up a complete message; compressed bodies must have ended cleanly
+static int response_finish(HttpResponse* resp) {
+    if (resp->inflater) {
+        // Drain a stream that was empty or fed nothing past its header
+        InflateStatus st = inflater_feed(resp->inflater, NULL, 0);
+        if (st != INFLATE_DONE) return READ_ERROR;
         
-        // Append chunk to result
-        result = realloc(result, total_size + chunk_size + 1);
-        memcpy(result + total_size, p, chunk_size);
-        total_size += chunk_size;
-        result[total_size] = '\0';
+        if (resp->sink) {
+            size_t len;
+            const char* data = inflater_drain(resp->inflater, &len);
+            if (len > 0 && resp->sink(data, len, resp->sink_data) != 0) return READ_ERROR;
+            return READ_OK;
+        }
         
-        p += chunk_size;
-        if (*p == '\r') p++;
-        if (*p == '\n') p++;
+        buffer_release(resp->body, resp->body_cap);
+        resp->body = inflater_take_output(resp->inflater, &resp->body_len);
+        resp->body_pooled = 0;
+        inflater_free(resp->inflater);
+        resp->inflater = NULL;
+        return READ_OK;
     }
     
+    resp->body[resp->body_len] = '\0';
+    return READ_OK;
+}
+
+static void response_init(HttpResponse* resp) {
+    memset(resp, 0, sizeof(*resp));
+    resp->head = buffer_acquire(HEAD_BUFFER_SIZE, &resp->head_cap);
+    resp->content_length = -1;
+    resp->encoding = CONTENT_IDENTITY;
+}
+
+static void response_free(HttpResponse* resp) {
+    buffer_release(resp->head, resp->head_cap);
+    inflater_free(resp->inflater);
+    if (resp->body_pooled) {
+        buffer_release(resp->body, resp->body_cap);
+    } else {
+        free(resp->body);
+    }
+    free(resp->spill);
+    resp->head = NULL;
+    resp->body = NULL;
+    resp->inflater = NULL;
+    resp->spill = NULL;
+    resp->spill_len = 0;
+}
+
+// Read whatever the socket has and advance the response. Blocking sockets
+// loop until the message is complete; non-blocking ones return
+// READ_PENDING once the socket runs dry.
+static int response_read(int fd, HttpResponse* resp) {
+    while (1) {
+        char* dst;
+        size_t room;
+        
+        if (!resp->header_len) {
+            dst = resp->head + resp->head_len;
+            room = resp->head_cap - resp->head_len - 1;
+            if (room == 0) return READ_ERROR; // header block too large
+        } else {
+            body_reserve(resp);
+            dst = resp->body + resp->body_len;
+            room = resp->body_cap - resp->body_len - 1;
+            // Never read past this message; the socket may be reused
+            if (resp->content_length >= 0 &&
+                room > (size_t)resp->content_length - resp->received) {
+                room = (size_t)resp->content_length - resp->received;
+            }
+        }
+        
+        ssize_t n;
+        if (resp->preload_len > 0) {
+            n = resp->preload_len < room ? resp->preload_len : room;
+            memcpy(dst, resp->preload, n);
+            resp->preload += n;
+            resp->preload_len -= n;
+        } else {
+            n = read(fd, dst, room);
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return READ_PENDING;
+        if (n <= 0 && resp->head_len == 0) return READ_CLOSED;
+        if (n < 0) return READ_ERROR;
+        
+        if (!resp->header_len) {
+            resp->head_len += n;
+            resp->head[resp->head_len] = '\0';
+            if (find_header_end(resp, n)) {
+                if (parse_headers(resp) < 0) return READ_ERROR;
+                if (body_start(resp) < 0) return READ_ERROR;
+            }
+        } else if (body_consume(resp, n) < 0) {
+            return READ_ERROR;
+        }
+        
+        if (response_complete(resp, n == 0)) {
+            response_spill(resp, resp->preload, resp->preload_len);
+            resp->preload_len = 0;
+            return response_finish(resp);
+        }
+        if (n == 0) return READ_ERROR;
+    }
+}
+
+// Take the decoded body of a complete response (caller must free).
+// The receive buffer itself is handed over; nothing is copied.
+static char* response_body(HttpResponse* resp, size_t* body_len) {
+    char* result = resp->body;
+    *body_len = resp->body_len;
+    resp->body = NULL;
     return result;
 }
 
-char* http_get(const char* url) {
-    char* host = NULL;
-    char* path = NULL;
+static int build_request(char* request, size_t size, const char* host, const char* path) {
+    return snprintf(request, size,
+                    "GET %s HTTP/1.1\r\nHost: %s\r\nAccept-Encoding: gzip, deflate\r\n"
+                    "Connection: keep-alive\r\n\r\n",
+                    path, host);
+}
+
+// Fill in req from a complete response; takes the body on success
+static int request_complete(HttpRequest* req, HttpResponse* resp) {
+    req->status = resp->status;
+    if (resp->status != 200) {
+        req->error = "unexpected HTTP status";
+        return 0;
+    }
+    if (resp->sink) return 1; // the body went to the sink
+    req->body = response_body(resp, &req->body_len);
+    return 1;
+}
+
+static void request_reset(HttpRequest* req) {
+    req->body = NULL;
+    req->body_len = 0;
+    req->status = 0;
+    req->error = NULL;
+}
+
+/* ---- Timeouts ---------------------------------------------------------- */
+
+static const HttpOptions default_options = {
+    .connect_timeout_ms = 5000,
+    .first_byte_timeout_ms = 10000,
+    .total_timeout_ms = 30000,
+    .max_retries = 2,
+    .backoff_base_ms = 200,
+    .backoff_max_ms = 2000,
+    .hedge_delay_ms = 0,
+};
+
+static HttpOptions options = default_options;
+static pthread_mutex_t options_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void http_set_options(const HttpOptions* opts) {
+    pthread_mutex_lock(&options_lock);
+    options = opts ? *opts : default_options;
+    pthread_mutex_unlock(&options_lock);
+}
+
+void http_get_options(HttpOptions* opts) {
+    pthread_mutex_lock(&options_lock);
+    *opts = options;
+    pthread_mutex_unlock(&options_lock);
+}
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Deadline for something that started at start and may take limit_ms;
+// 0 means no deadline
+static long long deadline_after(long long start, int limit_ms) {
+    return limit_ms > 0 ? start + limit_ms : 0;
+}
+
+static long long earliest(long long a, long long b) {
+    if (a == 0) return b;
+    if (b == 0) return a;
+    return a < b ? a : b;
+}
+
+// poll()-style timeout until deadline (-1 waits forever)
+static int wait_timeout(long long deadline, long long now) {
+    if (deadline == 0) return -1;
+    return deadline > now ? (int)(deadline - now) : 0;
+}
+
+/* ---- Batch requests ---------------------------------------------------- */
+
+#define BATCH_DEFAULT_CONCURRENCY 16
+
+typedef enum {
+    SLOT_IDLE,
+    SLOT_CONNECTING,
+    SLOT_SENDING,
+    SLOT_READING
+} SlotState;
+
+typedef struct {
+    SlotState state;
+    size_t index;          // position in the caller's request array
+    int fd;
+    int reused;            // socket came from the keep-alive pool
+    int retried;
+    char* host;
     int port;
+    DnsAddress addrs[DNS_MAX_ADDRS];
+    int addr_count;
+    int addr_next;         // next address to try if the current connect fails
+    char request[2048];
+    size_t request_len;
+    size_t sent;
+    long long started_ms;  // when the request was taken on
+    long long phase_ms;    // when the current connect or read phase began
+    HttpBodyFn sink;
+    void* sink_data;
+    HttpResponse resp;
+} BatchSlot;
+
+// Thin event-loop layer: epoll on Linux, poll() everywhere else
+typedef struct {
+#ifdef __linux__
+    int epfd;
+#else
+    struct pollfd* fds;
+#endif
+    size_t slot_count;
+} EventLoop;
+
+static int loop_init(EventLoop* loop, size_t slot_count) {
+    loop->slot_count = slot_count;
+#ifdef __linux__
+    loop->epfd = epoll_create1(0);
+    return loop->epfd < 0 ? -1 : 0;
+#else
+    loop->fds = malloc_safe(slot_count * sizeof(struct pollfd));
+    for (size_t i = 0; i < slot_count; i++) loop->fds[i].fd = -1;
+    return 0;
+#endif
+}
+
+static void loop_destroy(EventLoop* loop) {
+#ifdef __linux__
+    close(loop->epfd);
+#else
+    free(loop->fds);
+#endif
+}
+
+// Watch fd for slot; writable selects POLLOUT instead of POLLIN
+static void loop_watch(EventLoop* loop, size_t slot, int fd, int writable, int modify) {
+#ifdef __linux__
+    struct epoll_event ev;
+    ev.events = writable ? EPOLLOUT : EPOLLIN;
+    ev.data.u64 = slot;
+    epoll_ctl(loop->epfd, modify ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev);
+#else
+    (void)modify;
+    loop->fds[slot].fd = fd;
+    loop->fds[slot].events = writable ? POLLOUT : POLLIN;
+#endif
+}
+
+static void loop_unwatch(EventLoop* loop, size_t slot, int fd) {
+#ifdef __linux__
+    (void)slot;
+    epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+#else
+    (void)fd;
+    loop->fds[slot].fd = -1;
+#endif
+}
+
+// Wait for activity; fills ready[] with slot indices and returns the count
+static int loop_wait(EventLoop* loop, size_t* ready, int timeout_ms) {
+#ifdef __linux__
+    struct epoll_event events[64];
+    size_t max = loop->slot_count < 64 ? loop->slot_count : 64;
+    int n = epoll_wait(loop->epfd, events, (int)max, timeout_ms);
+    for (int i = 0; i < n; i++) ready[i] = events[i].data.u64;
+    return n;
+#else
+    int n = poll(loop->fds, loop->slot_count, timeout_ms);
+    if (n <= 0) return n;
+    int count = 0;
+    for (size_t i = 0; i < loop->slot_count; i++) {
+        if (loop->fds[i].fd >= 0 && loop->fds[i].revents) ready[count++] = i;
+    }
+    return count;
+#endif
+}
+
+static void finish_request(HttpRequest* req, const char* error, HttpCompletionFn on_complete,
+                           void* user_data) {
+    req->error = error;
+    if (on_complete) on_complete(req, user_data);
+}
+
+// Start a non-blocking connect to the slot's next untried address
+static int slot_connect_next(BatchSlot* slot) {
+    while (slot->addr_next < slot->addr_count) {
+        slot->fd = connect_address(&slot->addrs[slot->addr_next++], 1);
+        if (slot->fd >= 0) {
+            slot->state = SLOT_CONNECTING;
+            slot->phase_ms = now_ms();
+            return 0;
+        }
+    }
+    if (slot->addr_count > 0) dns_invalidate(slot->host);
+    slot->fd = -1;
+    return -1;
+}
+
+// Open (or reuse) a connection for reqs[index] and start sending
+static int slot_start(BatchSlot* slot, EventLoop* loop, size_t slot_idx, HttpRequest* req,
+                      size_t index) {
+    char* path = NULL;
+    if (parse_url(req->url, &slot->host, &path, &slot->port) < 0) return -1;
+    slot->request_len = build_request(slot->request, sizeof(slot->request), slot->host, path);
+    free(path);
     
-    if (parse_url(url, &host, &path, &port) < 0) {
-        return NULL;
+    slot->index = index;
+    slot->sent = 0;
+    slot->reused = 0;
+    if (!slot->retried) slot->started_ms = now_ms();
+    slot->fd = slot->retried ? -1 : pool_acquire(slot->host, slot->port);
+    if (slot->fd >= 0) {
+        slot->reused = 1;
+        set_nonblocking(slot->fd, 1);
+        slot->state = SLOT_SENDING;
+        slot->phase_ms = now_ms();
+    } else {
+        slot->addr_count = dns_resolve(slot->host, slot->port, slot->addrs, DNS_MAX_ADDRS);
+        slot->addr_next = 0;
+        if (slot_connect_next(slot) < 0) {
+            free(slot->host);
+            slot->host = NULL;
+            return -1;
+        }
     }
     
-    // Resolve hostname
-    struct hostent* server = gethostbyname(host);
-    if (!server) {
-        fprintf(stderr, "Failed to resolve %s\n", host);
-        free(host);
-        free(path);
-        return NULL;
+    loop_watch(loop, slot_idx, slot->fd, 1, 0);
+    return 0;
+}
+
+static void slot_release(BatchSlot* slot, EventLoop* loop, size_t slot_idx, int keep_alive) {
+    if (slot->fd >= 0) {
+        loop_unwatch(loop, slot_idx, slot->fd);
+        if (keep_alive) {
+            set_nonblocking(slot->fd, 0);
+            pool_release(slot->host, slot->port, slot->fd);
+        } else {
+            close(slot->fd);
+        }
+    }
+    free(slot->host);
+    slot->host = NULL;
+    slot->fd = -1;
+    slot->state = SLOT_IDLE;
+}
+
+// When the slot's current phase runs out of time: connecting and sending
+// share the connect timeout, the wait for the first response byte has its
+// own, and request_deadline caps everything. 0 means no deadline.
+static long long slot_deadline(const BatchSlot* slot, const HttpOptions* opts,
+                               long long request_deadline) {
+    long long phase = 0;
+    if (slot->state == SLOT_CONNECTING || slot->state == SLOT_SENDING) {
+        phase = deadline_after(slot->phase_ms, opts->connect_timeout_ms);
+    } else if (slot->state == SLOT_READING && slot->resp.head_len == 0) {
+        phase = deadline_after(slot->phase_ms, opts->first_byte_timeout_ms);
+    }
+    return earliest(phase, request_deadline);
+}
+
+static int slot_expired(const BatchSlot* slot, const HttpOptions* opts,
+                        long long request_deadline, long long now) {
+    long long deadline = slot_deadline(slot, opts, request_deadline);
+    return deadline != 0 && now >= deadline;
+}
+
+// Abandon whatever the slot is doing
+static void slot_abort(BatchSlot* slot, EventLoop* loop, size_t slot_idx) {
+    if (slot->state == SLOT_READING) response_free(&slot->resp);
+    slot_release(slot, loop, slot_idx, 0);
+}
+
+typedef enum {
+    STEP_PENDING,
+    STEP_DONE,
+    STEP_RETRY,    // pooled socket turned out to be dead; try a fresh one
+    STEP_FAILED
+} StepResult;
+
+// Drive one slot after its socket became ready
+static StepResult slot_advance(BatchSlot* slot, EventLoop* loop, size_t slot_idx,
+                               const char** error) {
+    if (slot->state == SLOT_CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(slot->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0) {
+            // Move on to the host's next address, if it has one
+            loop_unwatch(loop, slot_idx, slot->fd);
+            close(slot->fd);
+            if (slot_connect_next(slot) == 0) {
+                loop_watch(loop, slot_idx, slot->fd, 1, 0);
+                return STEP_PENDING;
+            }
+            slot->fd = -1;
+            *error = "connect failed";
+            return STEP_FAILED;
+        }
+        slot->state = SLOT_SENDING;
     }
     
-    // Create socket
-    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd < 0) {
-        perror("socket");
-        free(host);
-        free(path);
-        return NULL;
+    if (slot->state == SLOT_SENDING) {
+        while (slot->sent < slot->request_len) {
+            ssize_t n = send(slot->fd, slot->request + slot->sent,
+                             slot->request_len - slot->sent, SEND_FLAGS);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return STEP_PENDING;
+            if (n < 0) {
+                *error = "write failed";
+                return slot->reused ? STEP_RETRY : STEP_FAILED;
+            }
+            slot->sent += n;
+        }
+        response_init(&slot->resp);
+        slot->resp.sink = slot->sink;
+        slot->resp.sink_data = slot->sink_data;
+        slot->state = SLOT_READING;
+        slot->phase_ms = now_ms();
+        loop_watch(loop, slot_idx, slot->fd, 0, 1);
+        return STEP_PENDING;
     }
     
-    // Connect
-    struct sockaddr_in serv_addr;
-    memset(&serv_addr, 0, sizeof(serv_addr));
-    serv_addr.sin_family = AF_INET;
-    memcpy(&serv_addr.sin_addr.s_addr, server->h_addr, server->h_length);
-    serv_addr.sin_port = htons(port);
+    int rc = response_read(slot->fd, &slot->resp);
+    if (rc == READ_PENDING) return STEP_PENDING;
+    if (rc == READ_OK) return STEP_DONE;
     
-    if (connect(sockfd, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) < 0) {
-        perror("connect");
-        close(sockfd);
-        free(host);
-        free(path);
-        return NULL;
+    response_free(&slot->resp);
+    if (rc == READ_CLOSED) {
+        *error = "connection closed";
+        return slot->reused ? STEP_RETRY : STEP_FAILED;
+    }
+    *error = "read failed";
+    return STEP_FAILED;
+}
+
+// Start the next pending request in an idle slot, completing any that
+// can't even be started. Returns 1 if the slot is now busy.
+static int slot_fill(BatchSlot* slot, EventLoop* loop, size_t slot_idx, HttpRequest* reqs,
+                     size_t count, size_t* next, HttpCompletionFn on_complete, void* user_data) {
+    while (*next < count) {
+        size_t index = (*next)++;
+        slot->retried = 0;
+        if (slot_start(slot, loop, slot_idx, &reqs[index], index) == 0) return 1;
+        finish_request(&reqs[index], "connect failed", on_complete, user_data);
     }
+    return 0;
+}
+
+int http_get_many(HttpRequest* reqs, size_t count, int max_concurrent,
+                  HttpCompletionFn on_complete, void* user_data) {
+    if (max_concurrent <= 0) max_concurrent = BATCH_DEFAULT_CONCURRENCY;
+    size_t slot_count = (size_t)max_concurrent < count ? (size_t)max_concurrent : count;
+    if (slot_count == 0) return 0;
     
-    // Send HTTP request
-    char request[2048];
-    snprintf(request, sizeof(request),
-             "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n",
-             path, host);
+    for (size_t i = 0; i < count; i++) request_reset(&reqs[i]);
     
-    if (write(sockfd, request, strlen(request)) < 0) {
-        perror("write");
-        close(sockfd);
-        free(host);
-        free(path);
-        return NULL;
+    HttpOptions opts;
+    http_get_options(&opts);
+    
+    EventLoop loop;
+    if (loop_init(&loop, slot_count) < 0) {
+        for (size_t i = 0; i < count; i++) {
+            finish_request(&reqs[i], "event loop failed", on_complete, user_data);
+        }
+        return 0;
     }
     
-    // Read response
-    size_t capacity = BUFFER_SIZE;
-    char* response = malloc_safe(capacity);
-    size_t total_read = 0;
-    ssize_t n;
+    BatchSlot* slots = malloc_safe(slot_count * sizeof(BatchSlot));
+    size_t* ready = malloc_safe(slot_count * sizeof(size_t));
+    size_t next = 0;
+    size_t active = 0;
+    int succeeded = 0;
+    
+    for (size_t s = 0; s < slot_count; s++) {
+        slots[s].state = SLOT_IDLE;
+        slots[s].fd = -1;
+        slots[s].host = NULL;
+        slots[s].sink = NULL;
+        active += slot_fill(&slots[s], &loop, s, reqs, count, &next, on_complete, user_data);
+    }
     
-    while ((n = read(sockfd, response + total_read, capacity - total_read - 1)) > 0) {
-        total_read += n;
-        if (total_read >= capacity - 1) {
-            capacity *= 2;
-            response = realloc(response, capacity);
+    while (active > 0) {
+        long long wake = 0;
+        for (size_t s = 0; s < slot_count; s++) {
+            if (slots[s].state == SLOT_IDLE) continue;
+            long long total = deadline_after(slots[s].started_ms, opts.total_timeout_ms);
+            wake = earliest(wake, slot_deadline(&slots[s], &opts, total));
         }
+        
+        int n = loop_wait(&loop, ready, wait_timeout(wake, now_ms()));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) break;
+        
+        for (int r = 0; r < n; r++) {
+            size_t s = ready[r];
+            BatchSlot* slot = &slots[s];
+            if (slot->state == SLOT_IDLE) continue;
+            
+            const char* error = NULL;
+            StepResult step = slot_advance(slot, &loop, s, &error);
+            if (step == STEP_PENDING) continue;
+            
+            HttpRequest* req = &reqs[slot->index];
+            
+            if (step == STEP_RETRY && !slot->retried) {
+                slot_release(slot, &loop, s, 0);
+                slot->retried = 1;
+                if (slot_start(slot, &loop, s, req, slot->index) == 0) continue;
+                error = "connect failed";
+            } else if (step != STEP_DONE) {
+                slot_release(slot, &loop, s, 0);
+            } else {
+                slot_release(slot, &loop, s,
+                             slot->resp.keep_alive && slot->resp.spill_len == 0);
+                succeeded += request_complete(req, &slot->resp);
+                error = req->error;
+                response_free(&slot->resp);
+            }
+            
+            finish_request(req, error, on_complete, user_data);
+            active--;
+            active += slot_fill(slot, &loop, s, reqs, count, &next, on_complete, user_data);
+        }
+        
+        long long now = now_ms();
+        for (size_t s = 0; s < slot_count; s++) {
+            BatchSlot* slot = &slots[s];
+            if (slot->state == SLOT_IDLE) continue;
+            long long total = deadline_after(slot->started_ms, opts.total_timeout_ms);
+            if (!slot_expired(slot, &opts, total, now)) continue;
+            
+            slot_abort(slot, &loop, s);
+            finish_request(&reqs[slot->index], "timed out", on_complete, user_data);
+            active--;
+            active += slot_fill(slot, &loop, s, reqs, count, &next, on_complete, user_data);
+        }
+    }
+    
+    // Only reached with work outstanding if the event loop itself failed
+    for (size_t s = 0; s < slot_count; s++) {
+        if (slots[s].state == SLOT_IDLE) continue;
+        slot_abort(&slots[s], &loop, s);
+        finish_request(&reqs[slots[s].index], "event loop failed", on_complete, user_data);
+    }
+    while (next < count) {
+        finish_request(&reqs[next++], "event loop failed", on_complete, user_data);
+    }
+    
+    free(ready);
+    free(slots);
+    loop_destroy(&loop);
+    return succeeded;
+}
+
+/* ---- Single requests ---------------------------------------------------- */
+
+// One attempt at req within deadline, run on its own small event loop so
+// that every phase can time out. With hedging enabled a duplicate request
+// goes out once hedge_delay_ms passes without an answer, and whichever
+// response completes first wins.
+static int fetch_attempt(HttpRequest* req, const HttpOptions* opts, long long deadline,
+                         HttpBodyFn sink, void* sink_data) {
+    EventLoop loop;
+    if (loop_init(&loop, 2) < 0) {
+        req->error = "event loop failed";
+        return 0;
+    }
+    
+    BatchSlot slots[2];
+    size_t ready[2];
+    for (size_t s = 0; s < 2; s++) {
+        slots[s].state = SLOT_IDLE;
+        slots[s].fd = -1;
+        slots[s].host = NULL;
+        slots[s].retried = 0;
+        slots[s].sink = sink;
+        slots[s].sink_data = sink_data;
+    }
+    
+    long long hedge_at = deadline_after(now_ms(), opts->hedge_delay_ms);
+    size_t launched = 1;
+    int active = 0;
+    int finished = 0;
+    int ok = 0;
+    
+    if (slot_start(&slots[0], &loop, 0, req, 0) == 0) {
+        active++;
+    } else {
+        req->error = "connect failed";
     }
     
-    response[total_read] = '\0';
-    close(sockfd);
+    while (active > 0 && !finished) {
+        long long wake = deadline;
+        for (size_t s = 0; s < launched; s++) {
+            if (slots[s].state == SLOT_IDLE) continue;
+            wake = earliest(wake, slot_deadline(&slots[s], opts, deadline));
+        }
+        if (launched < 2) wake = earliest(wake, hedge_at);
+        
+        int n = loop_wait(&loop, ready, wait_timeout(wake, now_ms()));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            req->error = "event loop failed";
+            break;
+        }
+        
+        for (int r = 0; r < n && !finished; r++) {
+            BatchSlot* slot = &slots[ready[r]];
+            if (slot->state == SLOT_IDLE) continue;
+            
+            const char* error = NULL;
+            StepResult step = slot_advance(slot, &loop, ready[r], &error);
+            if (step == STEP_PENDING) continue;
+            
+            if (step == STEP_RETRY && !slot->retried) {
+                slot_release(slot, &loop, ready[r], 0);
+                slot->retried = 1;
+                if (slot_start(slot, &loop, ready[r], req, 0) == 0) continue;
+                error = "connect failed";
+            } else if (step != STEP_DONE) {
+                slot_release(slot, &loop, ready[r], 0);
+            } else {
+                slot_release(slot, &loop, ready[r],
+                             slot->resp.keep_alive && slot->resp.spill_len == 0);
+                ok = request_complete(req, &slot->resp);
+                response_free(&slot->resp);
+                finished = 1;
+                break;
+            }
+            req->error = error;
+            active--;
+        }
+        if (finished) break;
+        
+        long long now = now_ms();
+        for (size_t s = 0; s < launched; s++) {
+            if (slots[s].state == SLOT_IDLE || !slot_expired(&slots[s], opts, deadline, now)) {
+                continue;
+            }
+            slot_abort(&slots[s], &loop, s);
+            req->error = "timed out";
+            active--;
+        }
+        
+        if (launched < 2 && hedge_at != 0 && now >= hedge_at && active > 0) {
+            launched = 2;
+            if (slot_start(&slots[1], &loop, 1, req, 0) == 0) active++;
+        }
+    }
+    
+    // The losing hedge, or everything if the loop failed
+    for (size_t s = 0; s < launched; s++) {
+        if (slots[s].state != SLOT_IDLE) slot_abort(&slots[s], &loop, s);
+    }
+    loop_destroy(&loop);
+    return ok;
+}
+
+// Is a failed GET worth repeating? Network errors and overload are; a
+// definitive answer from the server is not.
+static int should_retry(const HttpRequest* req) {
+    return req->status == 0 || req->status == 429 || req->status >= 500;
+}
+
+// Full jitter: a random wait up to base * 2^attempt, capped at max. Each
+// thread draws from its own generator, seeded once, so callers retrying
+// at the same moment don't pick the same delays.
+static _Thread_local unsigned int backoff_seed;
+static _Thread_local int backoff_seeded;
+
+static int backoff_delay(const HttpOptions* opts, int attempt) {
+    long long cap = opts->backoff_base_ms;
+    for (int i = 0; i < attempt && cap < opts->backoff_max_ms; i++) cap *= 2;
+    if (cap > opts->backoff_max_ms) cap = opts->backoff_max_ms;
+    if (cap <= 0) return 0;
+    if (!backoff_seeded) {
+        backoff_seed = (unsigned int)now_ms() ^ (unsigned int)getpid() ^
+                       (unsigned int)(uintptr_t)&backoff_seed;
+        backoff_seeded = 1;
+    }
+    return rand_r(&backoff_seed) % (int)(cap + 1);
+}
+
+// Single GET with deadlines, retries and optional hedging
+static int http_fetch(HttpRequest* req, const HttpOptions* opts) {
+    long long deadline = deadline_after(now_ms(), opts->total_timeout_ms);
+    
+    char* host = NULL;
+    char* path = NULL;
+    int port;
+    request_reset(req);
+    if (parse_url(req->url, &host, &path, &port) < 0) {
+        req->error = "unsupported URL";
+        return 0;
+    }
     free(host);
     free(path);
     
-    // Find body (after \r\n\r\n)
-    char* body = strstr(response, "\r\n\r\n");
-    if (!body) {
-        free(response);
-        return NULL;
+    for (int attempt = 0; ; attempt++) {
+        request_reset(req);
+        if (fetch_attempt(req, opts, deadline, NULL, NULL)) return 1;
+        if (attempt >= opts->max_retries || !should_retry(req)) break;
+        
+        int delay = backoff_delay(opts, attempt);
+        if (deadline != 0 && now_ms() + delay >= deadline) break;
+        usleep((useconds_t)delay * 1000);
     }
     
-    char* headers = response;
-    *body = '\0'; // Split headers and body
-    body += 4;
+    if (req->status != 0) {
+        fprintf(stderr, "HTTP request failed: %s (status %d)\n", req->url, req->status);
+    } else {
+        fprintf(stderr, "HTTP request failed: %s (%s)\n", req->url,
+                req->error ? req->error : "unknown error");
+    }
+    return 0;
+}
+
+static void* fetch_body(void* url) {
+    HttpOptions opts;
+    http_get_options(&opts);
+    HttpRequest req = { .url = url };
+    http_fetch(&req, &opts);
+    return req.body;
+}
+
+int http_get_stream(const char* url, HttpBodyFn on_data, void* user_data) {
+    HttpOptions opts;
+    http_get_options(&opts);
+    opts.hedge_delay_ms = 0; // a duplicate would deliver the body twice
+    
+    HttpRequest req = { .url = url };
+    if (fetch_attempt(&req, &opts, deadline_after(now_ms(), opts.total_timeout_ms),
+                      on_data, user_data)) {
+        return 0;
+    }
+    fprintf(stderr, "HTTP request failed: %s (%s)\n", url,
+            req.error ? req.error : "unknown error");
+    return -1;
+}
+
+static void* copy_body(const void* body) {
+    return strdup_safe(body);
+}
+
+// Same URL modulo case in the scheme and host, a default port and an
+// empty path
+static void canonical_url(const char* url, char* out, size_t size) {
+    const char* rest = url;
+    if (strncasecmp(rest, "http://", 7) == 0) rest += 7;
+    size_t host_len = strcspn(rest, ":/");
+    const char* after = rest + host_len;
+    if (strncmp(after, ":80", 3) == 0 && (after[3] == '/' || after[3] == '\0')) after += 3;
+    
+    size_t len = snprintf(out, size, "http://%.*s%s%s", (int)host_len, rest,
+                          *after == '\0' ? "/" : "", after);
+    if (len >= size) len = size - 1;
+    for (size_t i = 7; i < 7 + host_len && i < len; i++) {
+        out[i] = tolower((unsigned char)out[i]);
+    }
+}
+
+static FlightGroup get_flights = FLIGHT_GROUP_INIT;
+
+char* http_get(const char* url) {
+    // Concurrent callers asking for the same URL share one request
+    char key[2048];
+    canonical_url(url, key, sizeof(key));
+    return flight_do(&get_flights, key, fetch_body, (void*)url, copy_body, NULL);
+}
+
+/* ---- Pipelining --------------------------------------------------------- */
+
+// Bound every blocking read on fd (0 removes the limit)
+static void set_receive_timeout(int fd, int timeout_ms) {
+    struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+#define PIPELINE_DEPTH 16
+
+// Send the requests in group (indices into reqs, all for host:port) on
+// one connection, keeping up to PIPELINE_DEPTH of them in flight, and read
+// the responses back in order. Returns how many were answered; a server
+// that closes early leaves the rest for the caller.
+static size_t pipeline_group(HttpRequest* reqs, const size_t* group, size_t count,
+                             const char* host, int port, const HttpOptions* opts,
+                             int fresh, int* succeeded) {
+    int fd = fresh ? -1 : pool_acquire(host, port);
+    int reused = fd >= 0;
+    if (fd < 0) fd = open_connection(host, port, opts->connect_timeout_ms);
+    if (fd < 0) return 0;
+    // Responses are read with blocking calls; don't let a stalled server hold them
+    set_receive_timeout(fd, opts->first_byte_timeout_ms);
+    
+    size_t sent = 0;
+    size_t answered = 0;
+    char* carry = NULL;        // bytes of the next response already read
+    size_t carry_len = 0;
+    int keep_alive = 1;
     
-    // Check status
-    if (strncmp(headers, "HTTP/1", 6) != 0 || !strstr(headers, "200")) {
-        fprintf(stderr, "HTTP request failed: %s\n", headers);
-        free(response);
-        return NULL;
+    while (answered < count && keep_alive) {
+        while (sent < count && sent - answered < PIPELINE_DEPTH) {
+            char request[2048];
+            char* req_host = NULL;
+            char* path = NULL;
+            int req_port;
+            parse_url(reqs[group[sent]].url, &req_host, &path, &req_port);
+            int len = build_request(request, sizeof(request), host, path);
+            free(req_host);
+            free(path);
+            if (send_all(fd, request, len) < 0) break;
+            sent++;
+        }
+        if (sent == answered) break;
+        
+        HttpResponse resp;
+        response_init(&resp);
+        resp.preload = carry;
+        resp.preload_len = carry_len;
+        int rc = response_read(fd, &resp);
+        free(carry);
+        carry = NULL;
+        carry_len = 0;
+        
+        if (rc != READ_OK) {
+            response_free(&resp);
+            keep_alive = 0;
+            // A dead pooled socket: start over on a fresh connection
+            if (rc == READ_CLOSED && reused && answered == 0) {
+                close(fd);
+                return pipeline_group(reqs, group, count, host, port, opts, 1, succeeded);
+            }
+            break;
+        }
+        
+        HttpRequest* req = &reqs[group[answered++]];
+        *succeeded += request_complete(req, &resp);
+        keep_alive = resp.keep_alive;
+        
+        // Whatever was read past this response starts the next one
+        carry = resp.spill;
+        carry_len = resp.spill_len;
+        resp.spill = NULL;
+        resp.spill_len = 0;
+        response_free(&resp);
     }
     
-    char* result;
-    // Check for chunked encoding
-    if (str_contains_case_insensitive(headers, "Transfer-Encoding: chunked")) {
-        result = decode_chunked(body);
+    if (keep_alive && answered == count && carry_len == 0) {
+        set_receive_timeout(fd, 0);
+        pool_release(host, port, fd);
     } else {
-        result = strdup_safe(body);
+        close(fd);
     }
+    free(carry);
+    return answered;
+}
+
+int http_get_pipelined(HttpRequest* reqs, size_t count) {
+    int succeeded = 0;
+    char* done = malloc_safe(count ? count : 1);
+    size_t* group = malloc_safe((count ? count : 1) * sizeof(size_t));
+    memset(done, 0, count);
     
-    free(response);
-    return result;
+    HttpOptions opts;
+    http_get_options(&opts);
+    for (size_t i = 0; i < count; i++) request_reset(&reqs[i]);
+    
+    for (size_t i = 0; i < count; i++) {
+        if (done[i]) continue;
+        
+        char* host = NULL;
+        char* path = NULL;
+        int port;
+        if (parse_url(reqs[i].url, &host, &path, &port) < 0) {
+            reqs[i].error = "unsupported URL";
+            done[i] = 1;
+            continue;
+        }
+        free(path);
+        
+        // Gather every remaining request for the same host:port
+        size_t n = 0;
+        for (size_t j = i; j < count; j++) {
+            if (done[j]) continue;
+            char* other_host = NULL;
+            char* other_path = NULL;
+            int other_port;
+            if (parse_url(reqs[j].url, &other_host, &other_path, &other_port) == 0) {
+                if (other_port == port && strcmp(other_host, host) == 0) {
+                    group[n++] = j;
+                    done[j] = 1;
+                }
+                free(other_host);
+                free(other_path);
+            }
+        }
+        
+        size_t answered = pipeline_group(reqs, group, n, host, port, &opts, 0, &succeeded);
+        free(host);
+        
+        // The server closed early; finish the rest one at a time
+        for (size_t k = answered; k < n; k++) {
+            succeeded += http_fetch(&reqs[group[k]], &opts);
+        }
+    }
+    
+    free(group);
+    free(done);
+    return succeeded;
 }
@@ -0,0 +1,640 @@
+#include "../include/inflate.h"
+#include "../include/core.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define MAX_BITS 15
+#define MAX_LCODES 286
+#define MAX_DCODES 30
+#define FIX_LCODES 288
+#define FAST_BITS 9
+#define WINDOW_SIZE 32768     // furthest a match may reach back
+
+// Canonical Huffman code: codes per length plus symbols in code order,
+// with a direct lookup table for codes of up to FAST_BITS bits
+typedef struct {
+    uint16_t count[MAX_BITS + 1];
+    uint16_t symbol[FIX_LCODES];
+    uint16_t fast[1 << FAST_BITS];  // (symbol << 4) | length, 0 for longer codes
+} Huffman;
+
+typedef enum {
+    ST_HEADER,
+    ST_BLOCK,
+    ST_STORED,
+    ST_CODES,
+    ST_TRAILER,
+    ST_DONE,
+    ST_ERROR
+} InflateState;
+
+// Result of one decoding step
+typedef enum {
+    STEP_OK,
+    STEP_STARVED,   // ran out of input; state rolled back to a resumable point
+    STEP_BAD
+} StepResult;
+
+struct Inflater {
+    InflateFormat format;
+    InflateState state;
+    int final_block;
+    
+    const unsigned char* in;    // current input: caller's data or pending
+    size_t in_len;
+    size_t in_pos;
+    unsigned char* pending;     // unconsumed input kept between feeds
+    size_t pending_cap;
+    
+    uint64_t bitbuf;
+    int bitcnt;
+    
+    size_t stored_left;
+    Huffman lencode;
+    Huffman distcode;
+    
+    char* out;
+    size_t out_len;
+    size_t out_cap;
+    size_t out_drained;         // out[0..out_drained) was handed out by inflater_drain
+    size_t out_checked;         // out[0..out_checked) is already in the checksum
+    size_t out_discarded;       // bytes dropped from the front of out
+    uint32_t crc;               // running CRC-32 (gzip)
+    uint32_t adler;             // running Adler-32 (zlib)
+};
+
+// Input position to return to when a step runs out of input midway
+typedef struct {
+    size_t in_pos;
+    uint64_t bitbuf;
+    int bitcnt;
+} Checkpoint;
+
+static const uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577
+};
+static const uint8_t dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_table_init(void) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc_table[n] = c;
+    }
+}
+
+// Continue a CRC-32 (start from 0)
+static uint32_t crc32_update(uint32_t crc, const char* data, size_t len) {
+    pthread_once(&crc_once, crc_table_init);
+    uint32_t c = crc ^ 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++) c = crc_table[(c ^ (unsigned char)data[i]) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+// Continue an Adler-32 (start from 1)
+static uint32_t adler32_update(uint32_t adler, const char* data, size_t len) {
+    uint32_t a = adler & 0xFFFF, b = adler >> 16;
+    while (len > 0) {
+        // 5552 is the most bytes that can be summed before b may overflow
+        size_t n = len < 5552 ? len : 5552;
+        len -= n;
+        while (n--) {
+            a += (unsigned char)*data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+/* ---- Bit input ---------------------------------------------------------- */
+
+static Checkpoint save(const Inflater* s) {
+    Checkpoint cp = { s->in_pos, s->bitbuf, s->bitcnt };
+    return cp;
+}
+
+static void restore(Inflater* s, const Checkpoint* cp) {
+    s->in_pos = cp->in_pos;
+    s->bitbuf = cp->bitbuf;
+    s->bitcnt = cp->bitcnt;
+}
+
+// Make sure at least n bits are buffered; 0 if the input runs out first
+static int need(Inflater* s, int n) {
+    while (s->bitcnt < n) {
+        if (s->in_pos == s->in_len) return 0;
+        s->bitbuf |= (uint64_t)s->in[s->in_pos++] << s->bitcnt;
+        s->bitcnt += 8;
+    }
+    return 1;
+}
+
+// Take n buffered bits (call need() first)
+static uint32_t bits(Inflater* s, int n) {
+    uint32_t v = (uint32_t)(s->bitbuf & ((1ull << n) - 1));
+    s->bitbuf >>= n;
+    s->bitcnt -= n;
+    return v;
+}
+
+static void align_to_byte(Inflater* s) {
+    bits(s, s->bitcnt & 7);
+}
+
+/* ---- Huffman codes ------------------------------------------------------ */
+
+// Build a code from per-symbol lengths. Returns 0 for a complete code,
+// > 0 for an incomplete one and < 0 if the lengths are over-subscribed.
+static int construct(Huffman* h, const uint8_t* length, int n) {
+    uint16_t offs[MAX_BITS + 1];
+    
+    memset(h->count, 0, sizeof(h->count));
+    for (int sym = 0; sym < n; sym++) h->count[length[sym]]++;
+    memset(h->fast, 0, sizeof(h->fast));
+    if (h->count[0] == n) return 0;
+    
+    int left = 1;
+    for (int len = 1; len <= MAX_BITS; len++) {
+        left <<= 1;
+        left -= h->count[len];
+        if (left < 0) return left;
+    }
+    
+    offs[1] = 0;
+    for (int len = 1; len < MAX_BITS; len++) offs[len + 1] = offs[len] + h->count[len];
+    for (int sym = 0; sym < n; sym++) {
+        if (length[sym]) h->symbol[offs[length[sym]]++] = sym;
+    }
+    
+    // Codes are stored bit-reversed in the stream; index the fast table that way
+    int code = 0;
+    int index = 0;
+    for (int len = 1; len <= FAST_BITS; len++) {
+        for (int k = 0; k < h->count[len]; k++, code++) {
+            int rev = 0;
+            for (int b = 0; b < len; b++) rev |= ((code >> b) & 1) << (len - 1 - b);
+            uint16_t entry = (uint16_t)((h->symbol[index++] << 4) | len);
+            for (int j = rev; j < (1 << FAST_BITS); j += 1 << len) h->fast[j] = entry;
+        }
+        code <<= 1;
+    }
+    return left;
+}
+
+// Decode one symbol: >= 0 on success, -1 when out of input, -2 on a bad code
+static int decode(Inflater* s, const Huffman* h) {
+    if (need(s, FAST_BITS)) {
+        uint16_t entry = h->fast[s->bitbuf & ((1 << FAST_BITS) - 1)];
+        if (entry) {
+            bits(s, entry & 15);
+            return entry >> 4;
+        }
+    }
+    
+    // Long code, or too few bits left for a table lookup: walk bit by bit
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len <= MAX_BITS; len++) {
+        if (!need(s, 1)) return -1;
+        code |= bits(s, 1);
+        int count = h->count[len];
+        if (code - count < first) return h->symbol[index + (code - first)];
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return -2;
+}
+
+static void build_fixed(Inflater* s) {
+    uint8_t lengths[FIX_LCODES];
+    int sym = 0;
+    for (; sym < 144; sym++) lengths[sym] = 8;
+    for (; sym < 256; sym++) lengths[sym] = 9;
+    for (; sym < 280; sym++) lengths[sym] = 7;
+    for (; sym < FIX_LCODES; sym++) lengths[sym] = 8;
+    construct(&s->lencode, lengths, FIX_LCODES);
+    
+    for (sym = 0; sym < MAX_DCODES; sym++) lengths[sym] = 5;
+    construct(&s->distcode, lengths, MAX_DCODES);
+}
+
+static StepResult read_dynamic_tables(Inflater* s) {
+    static const uint8_t order[19] = {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+    };
+    uint8_t lengths[MAX_LCODES + MAX_DCODES];
+    
+    if (!need(s, 14)) return STEP_STARVED;
+    int nlen = bits(s, 5) + 257;
+    int ndist = bits(s, 5) + 1;
+    int ncode = bits(s, 4) + 4;
+    if (nlen > MAX_LCODES || ndist > MAX_DCODES) return STEP_BAD;
+    
+    int index;
+    for (index = 0; index < ncode; index++) {
+        if (!need(s, 3)) return STEP_STARVED;
+        lengths[order[index]] = bits(s, 3);
+    }
+    for (; index < 19; index++) lengths[order[index]] = 0;
+    if (construct(&s->lencode, lengths, 19) != 0) return STEP_BAD;
+    
+    index = 0;
+    while (index < nlen + ndist) {
+        int sym = decode(s, &s->lencode);
+        if (sym == -1) return STEP_STARVED;
+        if (sym < 0) return STEP_BAD;
+        
+        if (sym < 16) {
+            lengths[index++] = sym;
+            continue;
+        }
+        
+        int len = 0;
+        int repeat;
+        if (sym == 16) {
+            if (index == 0) return STEP_BAD;
+            len = lengths[index - 1];
+            if (!need(s, 2)) return STEP_STARVED;
+            repeat = 3 + bits(s, 2);
+        } else if (sym == 17) {
+            if (!need(s, 3)) return STEP_STARVED;
+            repeat = 3 + bits(s, 3);
+        } else {
+            if (!need(s, 7)) return STEP_STARVED;
+            repeat = 11 + bits(s, 7);
+        }
+        if (index + repeat > nlen + ndist) return STEP_BAD;
+        while (repeat--) lengths[index++] = len;
+    }
+    
+    // The end-of-block code must be present
+    if (lengths[256] == 0) return STEP_BAD;
+    
+    // Incomplete codes are only allowed when they hold a single symbol
+    int err = construct(&s->lencode, lengths, nlen);
+    if (err < 0 || (err > 0 && nlen - s->lencode.count[0] != 1)) return STEP_BAD;
+    err = construct(&s->distcode, lengths + nlen, ndist);
+    if (err < 0 || (err > 0 && ndist - s->distcode.count[0] != 1)) return STEP_BAD;
+    return STEP_OK;
+}
+
+/* ---- Stream steps ------------------------------------------------------- */
+
+static void out_reserve(Inflater* s, size_t n) {
+    if (s->out_len + n + 1 <= s->out_cap) return;
+    size_t cap = s->out_cap ? s->out_cap : 65536;
+    while (s->out_len + n + 1 > cap) cap *= 2;
+    s->out = realloc(s->out, cap);
+    if (!s->out) {
+        fprintf(stderr, "Fatal: realloc failed\n");
+        exit(1);
+    }
+    s->out_cap = cap;
+}
+
+static StepResult read_byte(Inflater* s, unsigned* byte) {
+    if (!need(s, 8)) return STEP_STARVED;
+    *byte = bits(s, 8);
+    return STEP_OK;
+}
+
+// Skip a zero-terminated gzip header field
+static StepResult skip_cstring(Inflater* s) {
+    unsigned c;
+    do {
+        if (read_byte(s, &c) != STEP_OK) return STEP_STARVED;
+    } while (c != 0);
+    return STEP_OK;
+}
+
+static StepResult read_header(Inflater* s) {
+    if (s->format == INFLATE_AUTO) {
+        // A zlib header is two bytes that form a multiple of 31 with CM = 8
+        if (!need(s, 16)) return STEP_STARVED;
+        unsigned cmf = s->bitbuf & 0xFF;
+        unsigned flg = (s->bitbuf >> 8) & 0xFF;
+        int zlib = (cmf & 0x0F) == 8 && (cmf >> 4) <= 7 && ((cmf << 8) | flg) % 31 == 0;
+        s->format = zlib ? INFLATE_ZLIB : INFLATE_RAW;
+    }
+    
+    if (s->format == INFLATE_ZLIB) {
+        if (!need(s, 16)) return STEP_STARVED;
+        unsigned cmf = bits(s, 8);
+        unsigned flg = bits(s, 8);
+        if ((cmf & 0x0F) != 8 || ((cmf << 8) | flg) % 31 != 0 || (flg & 0x20)) return STEP_BAD;
+    } else if (s->format == INFLATE_GZIP) {
+        unsigned b[10];
+        for (int i = 0; i < 10; i++) {
+            if (read_byte(s, &b[i]) != STEP_OK) return STEP_STARVED;
+        }
+        if (b[0] != 0x1F || b[1] != 0x8B || b[2] != 8) return STEP_BAD;
+        unsigned flags = b[3];
+        
+        if (flags & 0x04) { // FEXTRA
+            unsigned lo, hi;
+            if (read_byte(s, &lo) != STEP_OK || read_byte(s, &hi) != STEP_OK) return STEP_STARVED;
+            for (unsigned n = lo | (hi << 8); n > 0; n--) {
+                if (read_byte(s, &lo) != STEP_OK) return STEP_STARVED;
+            }
+        }
+        if ((flags & 0x08) && skip_cstring(s) != STEP_OK) return STEP_STARVED; // FNAME
+        if ((flags & 0x10) && skip_cstring(s) != STEP_OK) return STEP_STARVED; // FCOMMENT
+        if (flags & 0x02) { // FHCRC
+            if (!need(s, 16)) return STEP_STARVED;
+            bits(s, 16);
+        }
+    }
+    
+    s->state = ST_BLOCK;
+    return STEP_OK;
+}
+
+static StepResult read_block_header(Inflater* s) {
+    if (!need(s, 3)) return STEP_STARVED;
+    s->final_block = bits(s, 1);
+    int type = bits(s, 2);
+    
+    if (type == 0) {
+        align_to_byte(s);
+        if (!need(s, 32)) return STEP_STARVED;
+        uint32_t len = bits(s, 16);
+        uint32_t nlen = bits(s, 16);
+        if (len != (~nlen & 0xFFFF)) return STEP_BAD;
+        s->stored_left = len;
+        s->state = ST_STORED;
+        return STEP_OK;
+    }
+    
+    if (type == 1) {
+        build_fixed(s);
+    } else if (type == 2) {
+        StepResult rc = read_dynamic_tables(s);
+        if (rc != STEP_OK) return rc;
+    } else {
+        return STEP_BAD;
+    }
+    s->state = ST_CODES;
+    return STEP_OK;
+}
+
+static void end_block(Inflater* s) {
+    s->state = s->final_block ? ST_TRAILER : ST_BLOCK;
+}
+
+// Copy a stored block; progress is kept even when the input runs out
+static StepResult copy_stored(Inflater* s) {
+    out_reserve(s, s->stored_left);
+    
+    // Whole bytes already pulled into the bit buffer come first
+    while (s->stored_left > 0 && s->bitcnt >= 8) {
+        s->out[s->out_len++] = (char)bits(s, 8);
+        s->stored_left--;
+    }
+    
+    size_t n = s->in_len - s->in_pos;
+    if (n > s->stored_left) n = s->stored_left;
+    memcpy(s->out + s->out_len, s->in + s->in_pos, n);
+    s->out_len += n;
+    s->in_pos += n;
+    s->stored_left -= n;
+    
+    if (s->stored_left > 0) return STEP_STARVED;
+    end_block(s);
+    return STEP_OK;
+}
+
+// Decode literals and matches until the end of the block, checkpointing
+// before every symbol so a short input only rolls back the last one
+static StepResult inflate_codes(Inflater* s) {
+    while (1) {
+        Checkpoint cp = save(s);
+        
+        int sym = decode(s, &s->lencode);
+        if (sym == -1) goto starved;
+        if (sym < 0) return STEP_BAD;
+        
+        if (sym < 256) {
+            out_reserve(s, 1);
+            s->out[s->out_len++] = (char)sym;
+            continue;
+        }
+        if (sym == 256) {
+            end_block(s);
+            return STEP_OK;
+        }
+        
+        sym -= 257;
+        if (sym >= 29) return STEP_BAD;
+        if (!need(s, length_extra[sym])) goto starved;
+        size_t len = length_base[sym] + bits(s, length_extra[sym]);
+        
+        int dsym = decode(s, &s->distcode);
+        if (dsym == -1) goto starved;
+        if (dsym < 0 || dsym >= 30) return STEP_BAD;
+        if (!need(s, dist_extra[dsym])) goto starved;
+        size_t dist = dist_base[dsym] + bits(s, dist_extra[dsym]);
+        if (dist > s->out_len) return STEP_BAD;
+        
+        out_reserve(s, len);
+        char* dst = s->out + s->out_len;
+        const char* src = dst - dist;
+        if (dist >= len) {
+            memcpy(dst, src, len);
+        } else {
+            // Overlapping match repeats the last dist bytes
+            for (size_t i = 0; i < len; i++) dst[i] = src[i];
+        }
+        s->out_len += len;
+        continue;
+    
+    starved:
+        restore(s, &cp);
+        return STEP_STARVED;
+    }
+}
+
+// Fold output not yet covered into the running checksum
+static void checksum_catch_up(Inflater* s) {
+    const char* data = s->out + s->out_checked;
+    size_t len = s->out_len - s->out_checked;
+    if (s->format == INFLATE_GZIP) {
+        s->crc = crc32_update(s->crc, data, len);
+    } else if (s->format == INFLATE_ZLIB) {
+        s->adler = adler32_update(s->adler, data, len);
+    }
+    s->out_checked = s->out_len;
+}
+
+static StepResult read_trailer(Inflater* s) {
+    align_to_byte(s);
+    checksum_catch_up(s);
+    
+    if (s->format == INFLATE_GZIP) {
+        // CRC-32 and input size, both little-endian
+        if (!need(s, 32)) return STEP_STARVED;
+        uint32_t crc = bits(s, 32);
+        if (!need(s, 32)) return STEP_STARVED;
+        uint32_t isize = bits(s, 32);
+        if (crc != s->crc) return STEP_BAD;
+        if (isize != (uint32_t)(s->out_discarded + s->out_len)) return STEP_BAD;
+    } else if (s->format == INFLATE_ZLIB) {
+        uint32_t adler = 0;
+        for (int i = 0; i < 4; i++) {
+            unsigned b;
+            if (read_byte(s, &b) != STEP_OK) return STEP_STARVED;
+            adler = (adler << 8) | b;
+        }
+        if (adler != s->adler) return STEP_BAD;
+    }
+    
+    s->state = ST_DONE;
+    return STEP_OK;
+}
+
+static InflateStatus run(Inflater* s) {
+    while (1) {
+        Checkpoint cp = save(s);
+        StepResult rc;
+        
+        switch (s->state) {
+            case ST_HEADER:  rc = read_header(s); break;
+            case ST_BLOCK:   rc = read_block_header(s); break;
+            case ST_STORED:  rc = copy_stored(s); break;
+            case ST_CODES:   rc = inflate_codes(s); break;
+            case ST_TRAILER: rc = read_trailer(s); break;
+            case ST_DONE:    return INFLATE_DONE;
+            default:         return INFLATE_ERROR;
+        }
+        
+        if (rc == STEP_BAD) {
+            s->state = ST_ERROR;
+            return INFLATE_ERROR;
+        }
+        if (rc == STEP_STARVED) {
+            // Stored and code steps keep their own progress
+            if (s->state != ST_STORED && s->state != ST_CODES) restore(s, &cp);
+            return INFLATE_NEED_MORE;
+        }
+    }
+}
+
+/* ---- Public API --------------------------------------------------------- */
+
+Inflater* inflater_new(InflateFormat format) {
+    Inflater* s = malloc_safe(sizeof(Inflater));
+    memset(s, 0, sizeof(*s));
+    s->format = format;
+    s->state = ST_HEADER;
+    s->adler = 1;
+    return s;
+}
+
+void inflater_free(Inflater* s) {
+    if (!s) return;
+    free(s->pending);
+    free(s->out);
+    free(s);
+}
+
+// Once output is being drained, only the last WINDOW_SIZE bytes before the
+// undrained part are still needed; drop the rest in large steps
+static void out_compact(Inflater* s) {
+    if (s->out_drained < 2 * WINDOW_SIZE) return;
+    size_t drop = s->out_drained - WINDOW_SIZE;
+    checksum_catch_up(s);
+    memmove(s->out, s->out + drop, s->out_len - drop);
+    s->out_len -= drop;
+    s->out_drained -= drop;
+    s->out_checked -= drop;
+    s->out_discarded += drop;
+}
+
+InflateStatus inflater_feed(Inflater* s, const unsigned char* data, size_t len) {
+    if (s->state == ST_DONE) return INFLATE_DONE;
+    if (s->state == ST_ERROR) return INFLATE_ERROR;
+    out_compact(s);
+    
+    size_t leftover = s->in_len - s->in_pos;
+    if (leftover == 0) {
+        // Nothing carried over: decode straight from the caller's buffer
+        s->in = data;
+        s->in_len = len;
+    } else {
+        if (leftover + len > s->pending_cap) {
+            s->pending_cap = (leftover + len) * 2;
+            unsigned char* grown = malloc_safe(s->pending_cap);
+            memcpy(grown, s->in + s->in_pos, leftover);
+            free(s->pending);
+            s->pending = grown;
+        } else {
+            memmove(s->pending, s->in + s->in_pos, leftover);
+        }
+        if (len > 0) memcpy(s->pending + leftover, data, len);
+        s->in = s->pending;
+        s->in_len = leftover + len;
+    }
+    s->in_pos = 0;
+    
+    InflateStatus status = run(s);
+    
+    // Keep what a rolled-back step still needs; the caller's buffer won't last
+    leftover = s->in_len - s->in_pos;
+    if (status == INFLATE_NEED_MORE && leftover > 0 && s->in != s->pending) {
+        if (leftover > s->pending_cap) {
+            free(s->pending);
+            s->pending_cap = leftover * 2;
+            s->pending = malloc_safe(s->pending_cap);
+        }
+        memcpy(s->pending, s->in + s->in_pos, leftover);
+        s->in = s->pending;
+        s->in_len = leftover;
+        s->in_pos = 0;
+    }
+    if (status != INFLATE_NEED_MORE) {
+        s->in = NULL;
+        s->in_len = s->in_pos = 0;
+    }
+    return status;
+}
+
+char* inflater_take_output(Inflater* s, size_t* len) {
+    out_reserve(s, 0);
+    s->out[s->out_len] = '\0';
+    
+    char* out = s->out;
+    *len = s->out_len;
+    s->out = NULL;
+    s->out_len = 0;
+    s->out_cap = 0;
+    return out;
+}
+
+const char* inflater_drain(Inflater* s, size_t* len) {
+    *len = s->out_len - s->out_drained;
+    if (*len == 0) return NULL;
+    const char* data = s->out + s->out_drained;
+    s->out_drained = s->out_len;
+    return data;
+}
@@ -1,267 +1,592 @@
 #include "../include/json.h"
 #include "../include/core.h"
+#include "../include/json_index.h"
+#include "../include/json_number.h"
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include <stdio.h>
+#include <math.h>
 
-static const char* skip_whitespace(const char* p) {
-    while (*p && isspace(*p)) p++;
+/* ---- Arena -------------------------------------------------------------- */
+
+#define ARENA_DEFAULT_BLOCK (64 * 1024)
+#define ARENA_ALIGN 16
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t size;
+    size_t used;
+    // Keeps data[] aligned for any value type
+    union {
+        long double ld;
+        void* ptr;
+    } align;
+    char data[];
+} ArenaBlock;
+
+struct JsonArena {
+    ArenaBlock* first;
+    ArenaBlock* current;
+    size_t block_size;
+};
+
+JsonArena* json_arena_new(size_t block_size) {
+    JsonArena* arena = malloc_safe(sizeof(JsonArena));
+    arena->first = NULL;
+    arena->current = NULL;
+    arena->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK;
+    return arena;
+}
+
+// Blocks are kept after a reset; a block's used count is only cleared once
+// allocation reaches it again, so resetting costs the same at any size.
+void json_arena_reset(JsonArena* arena) {
+    arena->current = arena->first;
+    if (arena->first) arena->first->used = 0;
+}
+
+void json_arena_free(JsonArena* arena) {
+    if (!arena) return;
+    ArenaBlock* block = arena->first;
+    while (block) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
+
+size_t json_arena_capacity(const JsonArena* arena) {
+    size_t total = 0;
+    for (ArenaBlock* block = arena->first; block; block = block->next) total += block->size;
+    return total;
+}
+
+static ArenaBlock* arena_block_new(size_t size) {
+    ArenaBlock* block = malloc_safe(sizeof(ArenaBlock) + size);
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+static void* arena_alloc(JsonArena* arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    size_t fresh_size = size > arena->block_size ? size : arena->block_size;
+    
+    ArenaBlock* block = arena->current;
+    while (!block || block->size - block->used < size) {
+        if (!block) {
+            // Very first allocation
+            if (!arena->first) arena->first = arena_block_new(fresh_size);
+            block = arena->first;
+            block->used = 0;
+        } else if (block->next && block->next->size >= size) {
+            // Reuse a block left over from before the last reset
+            block = block->next;
+            block->used = 0;
+        } else {
+            // Insert a fresh block after the current one
+            ArenaBlock* fresh = arena_block_new(fresh_size);
+            fresh->next = block->next;
+            block->next = fresh;
+            block = fresh;
+        }
+        arena->current = block;
+    }
+    
+    void* ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+/* ---- Parser ------------------------------------------------------------- */
+
+// Parser state. The structural index says where every token starts, so
+// the parser steps from token to token without scanning whitespace or
+// string bodies itself. Elements of open containers are collected on a
+// shared scratch stack that grows geometrically; each container is then
+// copied out once, at its final size. Arrays that hold only numbers and
+// nulls collect plain doubles on a second stack instead, NaN for null.
+typedef struct {
+    const char* json;
+    char* insitu;            // the same buffer when strings are decoded in place
+    const uint32_t* index;   // token offsets, ending with the input length
+    size_t next;             // next index entry
+    JsonArena* arena;        // NULL: every node is malloc'd
+    void** stack;
+    size_t depth;            // entries in use
+    size_t capacity;
+    double* numbers;
+    size_t number_depth;
+    size_t number_capacity;
+} JsonParser;
+
+static void* parser_alloc(JsonParser* ps, size_t size) {
+    if (ps->arena) return arena_alloc(ps->arena, size);
+    return malloc_safe(size);
+}
+
+static void parser_push(JsonParser* ps, void* item) {
+    if (ps->depth == ps->capacity) {
+        ps->capacity = ps->capacity ? ps->capacity * 2 : 64;
+        ps->stack = realloc(ps->stack, ps->capacity * sizeof(void*));
+        if (!ps->stack) {
+            fprintf(stderr, "Fatal: realloc failed\n");
+            exit(1);
+        }
+    }
+    ps->stack[ps->depth++] = item;
+}
+
+static void parser_push_number(JsonParser* ps, double number) {
+    if (ps->number_depth == ps->number_capacity) {
+        ps->number_capacity = ps->number_capacity ? ps->number_capacity * 2 : 256;
+        ps->numbers = realloc(ps->numbers, ps->number_capacity * sizeof(double));
+        if (!ps->numbers) {
+            fprintf(stderr, "Fatal: realloc failed\n");
+            exit(1);
+        }
+    }
+    ps->numbers[ps->number_depth++] = number;
+}
+
+// Give up on a container: free what it collected unless the arena owns it.
+// Object entries alternate key, value.
+static void parser_unwind(JsonParser* ps, size_t base, int keyed) {
+    if (!ps->arena) {
+        for (size_t i = base; i < ps->depth; i++) {
+            if (keyed && (i - base) % 2 == 0) {
+                free(ps->stack[i]);
+            } else {
+                json_free(ps->stack[i]);
+            }
+        }
+    }
+    ps->depth = base;
+}
+
+// Start of the next token; the terminating NUL once the input runs out
+static const char* peek(const JsonParser* ps) {
+    return ps->json + ps->index[ps->next];
+}
+
+static const char* advance(JsonParser* ps) {
+    const char* p = peek(ps);
+    if (*p) ps->next++;
     return p;
 }
 
-static JsonValue* parse_value(const char** p);
+// A scalar ended at end: it must run right up to the next token or be
+// followed by whitespace
+static int scalar_ends(const JsonParser* ps, const char* end) {
+    return end == peek(ps) || *end == ' ' || *end == '\t' || *end == '\n' || *end == '\r';
+}
 
-static JsonValue* parse_null(const char** p) {
-    if (strncmp(*p, "null", 4) != 0) return NULL;
-    *p += 4;
-    JsonValue* val = malloc_safe(sizeof(JsonValue));
-    val->type = JSON_NULL;
+static JsonValue* new_value(JsonParser* ps, JsonType type) {
+    JsonValue* val = parser_alloc(ps, sizeof(JsonValue));
+    val->type = type;
     return val;
 }
 
-static JsonValue* parse_bool(const char** p) {
-    JsonValue* val = malloc_safe(sizeof(JsonValue));
-    val->type = JSON_BOOL;
-    if (strncmp(*p, "true", 4) == 0) {
-        val->data.bool_val = 1;
-        *p += 4;
-    } else if (strncmp(*p, "false", 5) == 0) {
-        val->data.bool_val = 0;
-        *p += 5;
+static JsonValue* parse_value(JsonParser* ps);
+
+static int scan_null(const JsonParser* ps, const char* p) {
+    return strncmp(p, "null", 4) == 0 && scalar_ends(ps, p + 4);
+}
+
+static int scan_number(const JsonParser* ps, const char* p, double* num) {
+    const char* end = json_number_parse(p, num);
+    return end && scalar_ends(ps, end);
+}
+
+static JsonValue* parse_null(JsonParser* ps, const char* p) {
+    if (!scan_null(ps, p)) return NULL;
+    return new_value(ps, JSON_NULL);
+}
+
+static JsonValue* parse_bool(JsonParser* ps, const char* p) {
+    int b;
+    if (strncmp(p, "true", 4) == 0) {
+        b = 1;
+        p += 4;
+    } else if (strncmp(p, "false", 5) == 0) {
+        b = 0;
+        p += 5;
     } else {
-        free(val);
         return NULL;
     }
+    if (!scalar_ends(ps, p)) return NULL;
+    JsonValue* val = new_value(ps, JSON_BOOL);
+    val->data.bool_val = b;
     return val;
 }
 
-static JsonValue* parse_number(const char** p) {
-    char* end;
-    double num = strtod(*p, &end);
-    if (end == *p) return NULL;
+static JsonValue* parse_number(JsonParser* ps, const char* p) {
+    double num;
+    if (!scan_number(ps, p, &num)) return NULL;
     
-    *p = end;
-    JsonValue* val = malloc_safe(sizeof(JsonValue));
-    val->type = JSON_NUMBER;
+    JsonValue* val = new_value(ps, JSON_NUMBER);
     val->data.number_val = num;
     return val;
 }
 
-static JsonValue* parse_string(const char** p) {
-    if (**p != '"') return NULL;
-    (*p)++;
-    
-    const char* start = *p;
-    size_t len = 0;
-    while (**p && **p != '"') {
-        if (**p == '\\') (*p)++;
-        (*p)++;
-        len++;
+static size_t put_utf8(char* out, unsigned cp) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
     }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+static int read_hex4(const char* p, const char* end, unsigned* cp) {
+    if (end - p < 4) return -1;
+    *cp = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        unsigned digit;
+        if (c >= '0' && c <= '9') digit = (unsigned)(c - '0');
+        else if (c >= 'a' && c <= 'f') digit = (unsigned)(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') digit = (unsigned)(c - 'A' + 10);
+        else return -1;
+        *cp = *cp << 4 | digit;
+    }
+    return 0;
+}
+
+// Decode the escapes in src[0..len) into dst, which may be src itself:
+// the output is never longer than the input. Lone surrogates become
+// U+FFFD, as in the pull reader. Returns the decoded length, or -1 on a
+// bad escape.
+static ptrdiff_t decode_string(const char* src, size_t len, char* dst) {
+    const char* end = src + len;
+    char* out = dst;
     
-    if (**p != '"') return NULL;
-    
-    char* str = malloc_safe(len + 1);
-    const char* src = start;
-    char* dst = str;
-    
-    while (src < *p) {
-        if (*src == '\\') {
-            src++;
-            switch (*src) {
-                case 'n': *dst = '\n'; break;
-                case 't': *dst = '\t'; break;
-                case 'r': *dst = '\r'; break;
-                case '\\': *dst = '\\'; break;
-                case '"': *dst = '"'; break;
-                default: *dst = *src;
+    while (src < end) {
+        const char* escape = memchr(src, '\\', (size_t)(end - src));
+        size_t run = (size_t)((escape ? escape : end) - src);
+        memmove(out, src, run);
+        out += run;
+        if (!escape) break;
+        
+        src = escape + 2;
+        if (src > end) return -1;
+        switch (escape[1]) {
+            case '"': *out++ = '"'; break;
+            case '\\': *out++ = '\\'; break;
+            case '/': *out++ = '/'; break;
+            case 'b': *out++ = '\b'; break;
+            case 'f': *out++ = '\f'; break;
+            case 'n': *out++ = '\n'; break;
+            case 'r': *out++ = '\r'; break;
+            case 't': *out++ = '\t'; break;
+            case 'u': {
+                unsigned cp, low;
+                if (read_hex4(src, end, &cp) < 0) return -1;
+                src += 4;
+                if (cp >= 0xD800 && cp <= 0xDBFF) {
+                    if (end - src >= 6 && src[0] == '\\' && src[1] == 'u' &&
+                        read_hex4(src + 2, end, &low) == 0 && low >= 0xDC00 && low <= 0xDFFF) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        src += 6;
+                    } else {
+                        cp = 0xFFFD;
+                    }
+                } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                    cp = 0xFFFD;
+                }
+                out += put_utf8(out, cp);
+                break;
             }
-        } else {
-            *dst = *src;
+            default:
+                return -1;
         }
-        dst++;
-        src++;
     }
-    *dst = '\0';
-    
-    (*p)++;
+    return out - dst;
+}
+
+// Decode a string literal in one pass; the index already holds both of
+// its quotes. In situ the result is the literal's own bytes, terminated
+// where the closing quote was; otherwise it is a fresh copy.
+static char* parse_string_raw(JsonParser* ps, size_t* len_out) {
+    const char* start = peek(ps);
+    if (*start != '"') return NULL;
+    ps->next++;
+    const char* end = advance(ps);
+    if (*end != '"') return NULL;
+    start++;
     
-    JsonValue* val = malloc_safe(sizeof(JsonValue));
-    val->type = JSON_STRING;
+    size_t len = (size_t)(end - start);
+    char* str = ps->insitu ? ps->insitu + (start - ps->json) : parser_alloc(ps, len + 1);
+    if (!memchr(start, '\\', len)) {
+        if (!ps->insitu) memcpy(str, start, len);
+    } else {
+        ptrdiff_t decoded = decode_string(start, len, str);
+        if (decoded < 0) {
+            if (!ps->insitu && !ps->arena) free(str);
+            return NULL;
+        }
+        len = (size_t)decoded;
+    }
+    str[len] = '\0';
+    if (len_out) *len_out = len;
+    return str;
+}
+
+static JsonValue* parse_string(JsonParser* ps) {
+    size_t len;
+    char* str = parse_string_raw(ps, &len);
+    if (!str) return NULL;
+    JsonValue* val = new_value(ps, JSON_STRING);
     val->data.string_val = str;
+    val->data.string_len = len;
     return val;
 }
 
-static JsonValue* parse_array(const char** p) {
-    if (**p != '[') return NULL;
-    (*p)++;
-    
-    JsonArray* arr = malloc_safe(sizeof(JsonArray));
-    arr->items = NULL;
-    arr->count = 0;
-    
-    *p = skip_whitespace(*p);
-    if (**p == ']') {
-        (*p)++;
-        JsonValue* val = malloc_safe(sizeof(JsonValue));
-        val->type = JSON_ARRAY;
-        val->data.array_val = arr;
-        return val;
+// The numbers an array collected so far become ordinary elements
+static void unpack_numbers(JsonParser* ps, size_t number_base) {
+    for (size_t i = number_base; i < ps->number_depth; i++) {
+        double num = ps->numbers[i];
+        JsonValue* item = new_value(ps, num != num ? JSON_NULL : JSON_NUMBER);
+        item->data.number_val = num;
+        parser_push(ps, item);
     }
+    ps->number_depth = number_base;
+}
+
+// Copy collected numbers out as a packed array with a null bitmap
+static void pack_numbers(JsonParser* ps, JsonArray* arr, size_t number_base) {
+    arr->count = ps->number_depth - number_base;
+    arr->numbers = parser_alloc(ps, arr->count * sizeof(double));
+    memcpy(arr->numbers, ps->numbers + number_base, arr->count * sizeof(double));
     
-    while (1) {
-        *p = skip_whitespace(*p);
-        JsonValue* item = parse_value(p);
-        if (!item) {
-            // Cleanup
-            for (size_t i = 0; i < arr->count; i++) {
-                json_free(arr->items[i]);
-            }
-            free(arr->items);
-            free(arr);
-            return NULL;
+    for (size_t i = 0; i < arr->count; i++) {
+        if (arr->numbers[i] == arr->numbers[i]) continue;
+        if (!arr->nulls) {
+            size_t size = (arr->count + 7) / 8;
+            arr->nulls = parser_alloc(ps, size);
+            memset(arr->nulls, 0, size);
         }
-        
-        arr->items = realloc(arr->items, (arr->count + 1) * sizeof(JsonValue*));
-        arr->items[arr->count++] = item;
-        
-        *p = skip_whitespace(*p);
-        if (**p == ']') {
-            (*p)++;
-            break;
-        }
-        if (**p != ',') {
-            // Cleanup
-            for (size_t i = 0; i < arr->count; i++) {
-                json_free(arr->items[i]);
+        arr->nulls[i / 8] |= (unsigned char)(1u << (i % 8));
+    }
+    ps->number_depth = number_base;
+}
+
+static JsonValue* parse_array(JsonParser* ps) {
+    if (*advance(ps) != '[') return NULL;
+    
+    size_t base = ps->depth;
+    size_t number_base = ps->number_depth;
+    int packed = 1;          // only numbers and nulls so far
+    int has_number = 0;
+    
+    if (*peek(ps) == ']') {
+        ps->next++;
+    } else {
+        while (1) {
+            const char* p = peek(ps);
+            double num;
+            if (packed && (*p == '-' || (*p >= '0' && *p <= '9'))) {
+                ps->next++;
+                if (!scan_number(ps, p, &num)) goto fail;
+                parser_push_number(ps, num);
+                has_number = 1;
+            } else if (packed && *p == 'n') {
+                ps->next++;
+                if (!scan_null(ps, p)) goto fail;
+                parser_push_number(ps, NAN);
+            } else {
+                if (packed) {
+                    unpack_numbers(ps, number_base);
+                    packed = 0;
+                }
+                JsonValue* item = parse_value(ps);
+                if (!item) goto fail;
+                parser_push(ps, item);
             }
-            free(arr->items);
-            free(arr);
-            return NULL;
+            
+            char c = *advance(ps);
+            if (c == ']') break;
+            if (c != ',') goto fail;
         }
-        (*p)++;
     }
     
-    JsonValue* val = malloc_safe(sizeof(JsonValue));
-    val->type = JSON_ARRAY;
+    // All nulls stays an ordinary array
+    if (packed && !has_number) unpack_numbers(ps, number_base);
+    
+    JsonArray* arr = parser_alloc(ps, sizeof(JsonArray));
+    arr->count = ps->depth - base;
+    arr->items = NULL;
+    arr->numbers = NULL;
+    arr->nulls = NULL;
+    if (packed && has_number) {
+        pack_numbers(ps, arr, number_base);
+    } else if (arr->count > 0) {
+        arr->items = parser_alloc(ps, arr->count * sizeof(JsonValue*));
+        memcpy(arr->items, ps->stack + base, arr->count * sizeof(JsonValue*));
+    }
+    ps->depth = base;
+    
+    JsonValue* val = new_value(ps, JSON_ARRAY);
     val->data.array_val = arr;
     return val;
+
+fail:
+    ps->number_depth = number_base;
+    parser_unwind(ps, base, 0);
+    return NULL;
 }
 
-static JsonValue* parse_object(const char** p) {
-    if (**p != '{') return NULL;
-    (*p)++;
+// FNV-1a
+static uint32_t hash_key(const char* key) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)key; *p; p++) {
+        h = (h ^ *p) * 16777619u;
+    }
+    return h;
+}
+
+// Hash every key and, for wide objects, index them. Linear probing keeps
+// the first of duplicate keys ahead of later ones, as a scan would.
+static void object_index(JsonParser* ps, JsonObject* obj) {
+    obj->hashes = parser_alloc(ps, obj->count * sizeof(uint32_t));
+    for (size_t i = 0; i < obj->count; i++) obj->hashes[i] = hash_key(obj->keys[i]);
+    if (obj->count < JSON_OBJECT_INDEX_MIN) return;
     
-    JsonObject* obj = malloc_safe(sizeof(JsonObject));
-    obj->keys = NULL;
-    obj->values = NULL;
-    obj->count = 0;
+    size_t size = 16;
+    while (size < obj->count * 2) size *= 2;
+    obj->slots = parser_alloc(ps, size * sizeof(uint32_t));
+    memset(obj->slots, 0, size * sizeof(uint32_t));
+    obj->slot_mask = size - 1;
     
-    *p = skip_whitespace(*p);
-    if (**p == '}') {
-        (*p)++;
-        JsonValue* val = malloc_safe(sizeof(JsonValue));
-        val->type = JSON_OBJECT;
-        val->data.object_val = obj;
-        return val;
+    for (size_t i = 0; i < obj->count; i++) {
+        size_t slot = obj->hashes[i] & obj->slot_mask;
+        while (obj->slots[slot]) slot = (slot + 1) & obj->slot_mask;
+        obj->slots[slot] = (uint32_t)(i + 1);
     }
+}
+
+static JsonValue* parse_object(JsonParser* ps) {
+    if (*advance(ps) != '{') return NULL;
     
-    while (1) {
-        *p = skip_whitespace(*p);
-        JsonValue* key_val = parse_string(p);
-        if (!key_val) {
-            // Cleanup
-            for (size_t i = 0; i < obj->count; i++) {
-                free(obj->keys[i]);
-                json_free(obj->values[i]);
+    size_t base = ps->depth;
+    if (*peek(ps) == '}') {
+        ps->next++;
+    } else {
+        while (1) {
+            char* key = parse_string_raw(ps, NULL);
+            if (!key) {
+                parser_unwind(ps, base, 1);
+                return NULL;
             }
-            free(obj->keys);
-            free(obj->values);
-            free(obj);
-            return NULL;
-        }
-        
-        char* key = key_val->data.string_val;
-        free(key_val);
-        
-        *p = skip_whitespace(*p);
-        if (**p != ':') {
-            free(key);
-            // Cleanup
-            for (size_t i = 0; i < obj->count; i++) {
-                free(obj->keys[i]);
-                json_free(obj->values[i]);
+            parser_push(ps, key);
+            
+            JsonValue* value = NULL;
+            if (*advance(ps) == ':') value = parse_value(ps);
+            if (!value) {
+                parser_unwind(ps, base, 1);
+                return NULL;
             }
-            free(obj->keys);
-            free(obj->values);
-            free(obj);
-            return NULL;
-        }
-        (*p)++;
-        
-        *p = skip_whitespace(*p);
-        JsonValue* value = parse_value(p);
-        if (!value) {
-            free(key);
-            // Cleanup
-            for (size_t i = 0; i < obj->count; i++) {
-                free(obj->keys[i]);
-                json_free(obj->values[i]);
+            parser_push(ps, value);
+            
+            char c = *advance(ps);
+            if (c == '}') break;
+            if (c != ',') {
+                parser_unwind(ps, base, 1);
+                return NULL;
             }
-            free(obj->keys);
-            free(obj->values);
-            free(obj);
-            return NULL;
         }
-        
-        obj->keys = realloc(obj->keys, (obj->count + 1) * sizeof(char*));
-        obj->values = realloc(obj->values, (obj->count + 1) * sizeof(JsonValue*));
-        obj->keys[obj->count] = key;
-        obj->values[obj->count] = value;
-        obj->count++;
-        
-        *p = skip_whitespace(*p);
-        if (**p == '}') {
-            (*p)++;
-            break;
-        }
-        if (**p != ',') {
-            // Cleanup
-            for (size_t i = 0; i < obj->count; i++) {
-                free(obj->keys[i]);
-                json_free(obj->values[i]);
-            }
-            free(obj->keys);
-            free(obj->values);
-            free(obj);
-            return NULL;
+    }
+    
+    JsonObject* obj = parser_alloc(ps, sizeof(JsonObject));
+    obj->count = (ps->depth - base) / 2;
+    obj->keys = NULL;
+    obj->values = NULL;
+    obj->hashes = NULL;
+    obj->slots = NULL;
+    obj->slot_mask = 0;
+    if (obj->count > 0) {
+        obj->keys = parser_alloc(ps, obj->count * sizeof(char*));
+        obj->values = parser_alloc(ps, obj->count * sizeof(JsonValue*));
+        for (size_t i = 0; i < obj->count; i++) {
+            obj->keys[i] = ps->stack[base + 2 * i];
+            obj->values[i] = ps->stack[base + 2 * i + 1];
         }
-        (*p)++;
+        object_index(ps, obj);
     }
+    ps->depth = base;
     
-    JsonValue* val = malloc_safe(sizeof(JsonValue));
-    val->type = JSON_OBJECT;
+    JsonValue* val = new_value(ps, JSON_OBJECT);
     val->data.object_val = obj;
     return val;
 }
 
-static JsonValue* parse_value(const char** p) {
-    *p = skip_whitespace(*p);
+static JsonValue* parse_value(JsonParser* ps) {
+    const char* p = peek(ps);
+    char c = *p;
+    if (c == '"') return parse_string(ps);
+    if (c == '[') return parse_array(ps);
+    if (c == '{') return parse_object(ps);
     
-    if (**p == 'n') return parse_null(p);
-    if (**p == 't' || **p == 'f') return parse_bool(p);
-    if (**p == '"') return parse_string(p);
-    if (**p == '[') return parse_array(p);
-    if (**p == '{') return parse_object(p);
-    if (**p == '-' || isdigit(**p)) return parse_number(p);
+    // Scalars are a single index entry
+    advance(ps);
+    if (c == 'n') return parse_null(ps, p);
+    if (c == 't' || c == 'f') return parse_bool(ps, p);
+    if (c == '-' || (c >= '0' && c <= '9')) return parse_number(ps, p);
     
     return NULL;
 }
 
+static JsonValue* parse_document(const char* json_str, char* insitu, JsonArena* arena) {
+    uint32_t* index;
+    size_t len = strlen(json_str);
+    if (json_index_build(json_str, len, &index) == 0) return NULL;
+    
+    JsonParser ps = { json_str, insitu, index, 0, arena, NULL, 0, 0, NULL, 0, 0 };
+    
+    // A failed parse hands back everything it took from the arena
+    ArenaBlock* mark_block = arena ? arena->current : NULL;
+    size_t mark_used = mark_block ? mark_block->used : 0;
+    
+    JsonValue* val = parse_value(&ps);
+    free(ps.stack);
+    free(ps.numbers);
+    free(index);
+    
+    if (!val && arena) {
+        arena->current = mark_block;
+        if (mark_block) mark_block->used = mark_used;
+        else json_arena_reset(arena);
+    }
+    return val;
+}
+
 JsonValue* json_parse(const char* json_str) {
-    const char* p = json_str;
-    return parse_value(&p);
+    return parse_document(json_str, NULL, NULL);
+}
+
+JsonValue* json_parse_arena(const char* json_str, JsonArena* arena) {
+    return parse_document(json_str, NULL, arena);
+}
+
+JsonValue* json_parse_insitu(char* json_str, JsonArena* arena) {
+    if (!arena) return NULL;
+    return parse_document(json_str, json_str, arena);
 }
 
 void json_free(JsonValue* val) {
@@ -273,10 +598,12 @@ void json_free(JsonValue* val) {
             break;
         case JSON_ARRAY:
             if (val->data.array_val) {
-                for (size_t i = 0; i < val->data.array_val->count; i++) {
+                for (size_t i = 0; val->data.array_val->items && i < val->data.array_val->count; i++) {
                     json_free(val->data.array_val->items[i]);
                 }
                 free(val->data.array_val->items);
+                free(val->data.array_val->numbers);
+                free(val->data.array_val->nulls);
                 free(val->data.array_val);
             }
             break;
@@ -288,6 +615,8 @@ void json_free(JsonValue* val) {
                 }
                 free(val->data.object_val->keys);
                 free(val->data.object_val->values);
+                free(val->data.object_val->hashes);
+                free(val->data.object_val->slots);
                 free(val->data.object_val);
             }
             break;
@@ -298,18 +627,36 @@ void json_free(JsonValue* val) {
     free(val);
 }
 
-JsonValue* json_object_get(JsonValue* obj, const char* key) {
+JsonKey json_key(const char* name) {
+    JsonKey key = { name, hash_key(name) };
+    return key;
+}
+
+JsonValue* json_object_get_key(JsonValue* obj, const JsonKey* key) {
     if (!obj || obj->type != JSON_OBJECT) return NULL;
     
     JsonObject* o = obj->data.object_val;
+    if (o->slots) {
+        for (size_t slot = key->hash & o->slot_mask; o->slots[slot]; slot = (slot + 1) & o->slot_mask) {
+            size_t i = o->slots[slot] - 1;
+            if (o->hashes[i] == key->hash && strcmp(o->keys[i], key->name) == 0) return o->values[i];
+        }
+        return NULL;
+    }
+    
     for (size_t i = 0; i < o->count; i++) {
-        if (strcmp(o->keys[i], key) == 0) {
+        if (o->hashes[i] == key->hash && strcmp(o->keys[i], key->name) == 0) {
             return o->values[i];
         }
     }
     return NULL;
 }
 
+JsonValue* json_object_get(JsonValue* obj, const char* key) {
+    JsonKey prepared = json_key(key);
+    return json_object_get_key(obj, &prepared);
+}
+
 double json_as_number(JsonValue* val, double default_val) {
     if (!val || val->type != JSON_NUMBER) return default_val;
     return val->data.number_val;
@@ -324,3 +671,11 @@ JsonArray* json_as_array(JsonValue* val) {
     if (!val || val->type != JSON_ARRAY) return NULL;
     return val->data.array_val;
 }
+
+const double* json_as_double_array(JsonValue* val, size_t* count, const unsigned char** nulls) {
+    JsonArray* arr = json_as_array(val);
+    if (!arr || !arr->numbers) return NULL;
+    *count = arr->count;
+    if (nulls) *nulls = arr->nulls;
+    return arr->numbers;
+}
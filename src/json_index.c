@@ -0,0 +1,256 @@
+#include "../include/json_index.h"
+#include "../include/core.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL 1
+#endif
+
+#define BLOCK 64
+
+// Character classes of one block, one bit per byte
+typedef struct {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t op;         // { } [ ] : ,
+    uint64_t space;      // JSON whitespace only, not \v or \f
+} BlockMasks;
+
+typedef void (*ClassifyFn)(const unsigned char* block, BlockMasks* m);
+
+/* ---- Kernels ------------------------------------------------------------ */
+
+// Portable kernel: eight bytes at a time in a general-purpose register
+#define ONES 0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+
+// High bit set in every byte of word equal to c
+static uint64_t bytes_equal(uint64_t word, unsigned char c) {
+    uint64_t x = word ^ (ONES * c);
+    uint64_t nonzero = ((x & ~HIGHS) + ~HIGHS) | x;
+    return ~nonzero & HIGHS;
+}
+
+// Gather the high bit of each byte into one bit per byte, first byte lowest
+static uint64_t byte_bits(uint64_t highs) {
+    return highs * 0x0002040810204081ULL >> 56;
+}
+
+static void classify_scalar(const unsigned char* block, BlockMasks* m) {
+    memset(m, 0, sizeof(*m));
+    for (int i = 0; i < BLOCK / 8; i++) {
+        uint64_t word;
+        memcpy(&word, block + 8 * i, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        word = __builtin_bswap64(word);
+#endif
+        // Setting bit 5 folds [ and ] onto { and }
+        uint64_t folded = word | ONES * 0x20;
+        uint64_t op = bytes_equal(folded, '{') | bytes_equal(folded, '}') |
+                      bytes_equal(word, ':') | bytes_equal(word, ',');
+        uint64_t space = bytes_equal(word, ' ') | bytes_equal(word, '\t') |
+                         bytes_equal(word, '\n') | bytes_equal(word, '\r');
+        int shift = 8 * i;
+        m->quote |= byte_bits(bytes_equal(word, '"')) << shift;
+        m->backslash |= byte_bits(bytes_equal(word, '\\')) << shift;
+        m->op |= byte_bits(op) << shift;
+        m->space |= byte_bits(space) << shift;
+    }
+}
+
+#ifdef __SSE2__
+static void classify_sse2(const unsigned char* block, BlockMasks* m) {
+    memset(m, 0, sizeof(*m));
+    for (int i = 0; i < BLOCK / 16; i++) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(block + 16 * i));
+        // Setting bit 5 folds [ and ] onto { and }
+        __m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        __m128i op = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')),
+                         _mm_cmpeq_epi8(folded, _mm_set1_epi8('}'))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8(','))));
+        __m128i space = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+        int shift = 16 * i;
+        m->quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) << shift;
+        m->backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))) << shift;
+        m->op |= (uint64_t)(uint16_t)_mm_movemask_epi8(op) << shift;
+        m->space |= (uint64_t)(uint16_t)_mm_movemask_epi8(space) << shift;
+    }
+}
+#endif
+
+#ifdef HAVE_AVX2_KERNEL
+__attribute__((target("avx2")))
+static void classify_avx2(const unsigned char* block, BlockMasks* m) {
+    memset(m, 0, sizeof(*m));
+    for (int i = 0; i < BLOCK / 32; i++) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(block + 32 * i));
+        __m256i folded = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        __m256i op = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(folded, _mm256_set1_epi8('{')),
+                            _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('}'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')),
+                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8(','))));
+        __m256i space = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+        int shift = 32 * i;
+        m->quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))) << shift;
+        m->backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))) << shift;
+        m->op |= (uint64_t)(uint32_t)_mm256_movemask_epi8(op) << shift;
+        m->space |= (uint64_t)(uint32_t)_mm256_movemask_epi8(space) << shift;
+    }
+}
+#endif
+
+static ClassifyFn kernel_for(JsonIndexKernel kernel) {
+    switch (kernel) {
+        case JSON_INDEX_AUTO:
+#ifdef HAVE_AVX2_KERNEL
+            if (__builtin_cpu_supports("avx2")) return classify_avx2;
+#endif
+#ifdef __SSE2__
+            return classify_sse2;
+#else
+            return classify_scalar;
+#endif
+        case JSON_INDEX_SCALAR:
+            return classify_scalar;
+#ifdef __SSE2__
+        case JSON_INDEX_SSE2:
+            return classify_sse2;
+#endif
+#ifdef HAVE_AVX2_KERNEL
+        case JSON_INDEX_AVX2:
+            return __builtin_cpu_supports("avx2") ? classify_avx2 : NULL;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+static ClassifyFn classify;
+static pthread_once_t classify_once = PTHREAD_ONCE_INIT;
+
+static void choose_kernel(void) {
+    classify = kernel_for(JSON_INDEX_AUTO);
+}
+
+int json_index_set_kernel(JsonIndexKernel kernel) {
+    pthread_once(&classify_once, choose_kernel);
+    ClassifyFn fn = kernel_for(kernel);
+    if (!fn) return -1;
+    classify = fn;
+    return 0;
+}
+
+/* ---- Index -------------------------------------------------------------- */
+
+// State carried from one block into the next
+typedef struct {
+    uint64_t escaped;      // 1 if the next block starts with an escaped byte
+    uint64_t in_string;    // all ones while inside a string
+    uint64_t token;        // 1 if the last byte belonged to a token
+} Carry;
+
+// Bit i set where byte i follows an odd-length run of backslashes
+static uint64_t find_escaped(uint64_t backslash, uint64_t* carry) {
+    const uint64_t even_bits = 0x5555555555555555ULL;
+    
+    backslash &= ~*carry;
+    uint64_t follows_escape = backslash << 1 | *carry;
+    
+    // Adding each run's start to the run carries out past its end; runs
+    // that start on an odd bit are flipped so every run looks even-aligned
+    uint64_t odd_starts = backslash & ~even_bits & ~follows_escape;
+    uint64_t even_starts = odd_starts + backslash;
+    *carry = even_starts < odd_starts;
+    
+    uint64_t invert = even_starts << 1;
+    return (even_bits ^ invert) & follows_escape;
+}
+
+// Each bit becomes the XOR of itself and every bit below it
+static uint64_t prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+static uint64_t block_positions(const BlockMasks* m, Carry* carry) {
+    uint64_t escaped = find_escaped(m->backslash, &carry->escaped);
+    uint64_t quote = m->quote & ~escaped;
+    
+    // Covers each opening quote and the string body, not the closing quote
+    uint64_t in_string = prefix_xor(quote) ^ carry->in_string;
+    carry->in_string = (uint64_t)((int64_t)in_string >> 63);
+    
+    uint64_t token = ~(m->op | m->space | m->quote | in_string);
+    uint64_t token_starts = token & ~(token << 1 | carry->token);
+    carry->token = token >> 63;
+    
+    return (m->op & ~in_string) | quote | token_starts;
+}
+
+size_t json_index_build(const char* json, size_t len, uint32_t** positions) {
+    *positions = NULL;
+    if (len >= UINT32_MAX) return 0;
+    pthread_once(&classify_once, choose_kernel);
+    
+    size_t capacity = len / 8 + 2 * BLOCK;
+    uint32_t* out = malloc_safe(capacity * sizeof(uint32_t));
+    size_t count = 0;
+    
+    Carry carry = { 0, 0, 0 };
+    BlockMasks masks;
+    unsigned char tail[BLOCK];
+    
+    for (size_t base = 0; base < len; base += BLOCK) {
+        const unsigned char* block = (const unsigned char*)json + base;
+        if (len - base < BLOCK) {
+            // Pad the last block with whitespace
+            memset(tail, ' ', BLOCK);
+            memcpy(tail, block, len - base);
+            block = tail;
+        }
+        
+        classify(block, &masks);
+        uint64_t bits = block_positions(&masks, &carry);
+        
+        if (capacity - count < BLOCK + 1) {
+            capacity *= 2;
+            out = realloc(out, capacity * sizeof(uint32_t));
+            if (!out) {
+                fprintf(stderr, "Fatal: realloc failed\n");
+                exit(1);
+            }
+        }
+        while (bits) {
+            out[count++] = (uint32_t)(base + __builtin_ctzll(bits));
+            bits &= bits - 1;
+        }
+    }
+    
+    out[count++] = (uint32_t)len;
+    *positions = out;
+    return count;
+}
@@ -0,0 +1,226 @@
+#include "../include/json.h"
+#include "../include/core.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define QUERY_MAX_ACTIVE 8   // path steps a single value may match at once
+
+typedef enum {
+    STEP_KEY,
+    STEP_INDEX,
+    STEP_ALL
+} StepKind;
+
+// One node of the path trie; field >= 0 where a path ends
+typedef struct QueryNode {
+    StepKind kind;
+    char* key;
+    size_t index;
+    int field;
+    struct QueryNode* children;
+    struct QueryNode* next;     // sibling
+} QueryNode;
+
+struct JsonQuery {
+    QueryNode root;
+    size_t field_count;
+};
+
+static QueryNode* node_child(QueryNode* parent, StepKind kind, const char* key, size_t key_len,
+                             size_t index) {
+    for (QueryNode* child = parent->children; child; child = child->next) {
+        if (child->kind != kind) continue;
+        if (kind == STEP_INDEX && child->index != index) continue;
+        if (kind == STEP_KEY && (strlen(child->key) != key_len ||
+                                 memcmp(child->key, key, key_len) != 0)) continue;
+        return child;
+    }
+    
+    QueryNode* child = malloc_safe(sizeof(QueryNode));
+    memset(child, 0, sizeof(*child));
+    child->kind = kind;
+    child->index = index;
+    child->field = -1;
+    if (kind == STEP_KEY) {
+        child->key = malloc_safe(key_len + 1);
+        memcpy(child->key, key, key_len);
+        child->key[key_len] = '\0';
+    }
+    child->next = parent->children;
+    parent->children = child;
+    return child;
+}
+
+// Add one path to the trie; -1 if it is malformed
+static int add_path(QueryNode* root, const char* path, int field) {
+    QueryNode* node = root;
+    const char* p = path;
+    
+    while (*p) {
+        if (*p == '[') {
+            p++;
+            if (*p == '*' && p[1] == ']') {
+                node = node_child(node, STEP_ALL, NULL, 0, 0);
+                p += 2;
+            } else {
+                if (*p < '0' || *p > '9') return -1;
+                char* end;
+                size_t index = strtoul(p, &end, 10);
+                if (*end != ']') return -1;
+                node = node_child(node, STEP_INDEX, NULL, 0, index);
+                p = end + 1;
+            }
+        } else {
+            if (*p == '.') {
+                if (node == root) return -1;
+                p++;
+            }
+            size_t len = strcspn(p, ".[");
+            if (len == 0) return -1;
+            node = node_child(node, STEP_KEY, p, len, 0);
+            p += len;
+        }
+    }
+    
+    if (node == root || node->field >= 0) return -1;
+    node->field = field;
+    return 0;
+}
+
+static void node_free(QueryNode* node) {
+    QueryNode* child = node->children;
+    while (child) {
+        QueryNode* next = child->next;
+        node_free(child);
+        free(child->key);
+        free(child);
+        child = next;
+    }
+}
+
+JsonQuery* json_query_compile(const char* const* paths, size_t count) {
+    JsonQuery* query = malloc_safe(sizeof(JsonQuery));
+    memset(query, 0, sizeof(*query));
+    query->root.field = -1;
+    query->field_count = count;
+    
+    for (size_t i = 0; i < count; i++) {
+        if (add_path(&query->root, paths[i], (int)i) < 0) {
+            json_query_free(query);
+            return NULL;
+        }
+    }
+    return query;
+}
+
+void json_query_free(JsonQuery* query) {
+    if (!query) return;
+    node_free(&query->root);
+    free(query);
+}
+
+/* ---- Matching ----------------------------------------------------------- */
+
+// Trie nodes the current value is reached by
+typedef struct {
+    const QueryNode* nodes[QUERY_MAX_ACTIVE];
+    int count;
+} ActiveSet;
+
+static void active_children(const ActiveSet* parent, ActiveSet* out, const char* key,
+                            size_t index, int is_index) {
+    out->count = 0;
+    for (int i = 0; i < parent->count; i++) {
+        for (const QueryNode* child = parent->nodes[i]->children; child; child = child->next) {
+            int match;
+            if (is_index) {
+                match = child->kind == STEP_ALL ||
+                        (child->kind == STEP_INDEX && child->index == index);
+            } else {
+                match = child->kind == STEP_KEY && strcmp(child->key, key) == 0;
+            }
+            if (match && out->count < QUERY_MAX_ACTIVE) out->nodes[out->count++] = child;
+        }
+    }
+}
+
+static void store(JsonQueryField* field, const JsonToken* tok) {
+    if (field->count >= field->max) return;
+    
+    if (field->type == JSON_QUERY_NUMBER) {
+        double* out = field->out;
+        out[field->count++] = tok && tok->type == JSON_TOKEN_NUMBER ? tok->number : NAN;
+        return;
+    }
+    
+    char* slot = (char*)field->out + field->count++ * field->width;
+    size_t len = 0;
+    if (tok && tok->type == JSON_TOKEN_STRING) {
+        len = tok->string_len < field->width - 1 ? tok->string_len : field->width - 1;
+        memcpy(slot, tok->string, len);
+    }
+    slot[len] = '\0';
+}
+
+// Match the value whose first token is tok. Returns 0, or -1 on error.
+static int match_value(JsonReader* reader, JsonToken* tok, const ActiveSet* active,
+                       JsonQueryField* fields) {
+    int is_container = tok->type == JSON_TOKEN_OBJECT_START || tok->type == JSON_TOKEN_ARRAY_START;
+    
+    for (int i = 0; i < active->count; i++) {
+        int field = active->nodes[i]->field;
+        if (field >= 0) store(&fields[field], is_container ? NULL : tok);
+    }
+    if (!is_container) return 0;
+    
+    // Nothing below here is wanted
+    int wanted = 0;
+    for (int i = 0; i < active->count; i++) wanted |= active->nodes[i]->children != NULL;
+    if (!wanted) return json_reader_skip(reader, tok) == JSON_TOKEN_ERROR ? -1 : 0;
+    
+    int is_object = tok->type == JSON_TOKEN_OBJECT_START;
+    JsonTokenType end = is_object ? JSON_TOKEN_OBJECT_END : JSON_TOKEN_ARRAY_END;
+    ActiveSet child;
+    
+    for (size_t index = 0; ; index++) {
+        JsonTokenType type = json_reader_next(reader, tok);
+        if (type == end) return 0;
+        if (type == JSON_TOKEN_ERROR || type == JSON_TOKEN_NEED_MORE) return -1;
+        
+        if (is_object) {
+            active_children(active, &child, tok->string, 0, 0);
+            type = json_reader_next(reader, tok);
+            if (type == JSON_TOKEN_ERROR || type == JSON_TOKEN_NEED_MORE) return -1;
+        } else {
+            active_children(active, &child, NULL, index, 1);
+        }
+        
+        if (child.count == 0 && (type == JSON_TOKEN_OBJECT_START || type == JSON_TOKEN_ARRAY_START)) {
+            if (json_reader_skip(reader, tok) == JSON_TOKEN_ERROR) return -1;
+        } else if (match_value(reader, tok, &child, fields) < 0) {
+            return -1;
+        }
+    }
+}
+
+int json_query_run(const JsonQuery* query, const char* json, size_t len,
+                   JsonQueryField* fields) {
+    ActiveSet root = { { &query->root }, 1 };
+    for (size_t i = 0; i < query->field_count; i++) fields[i].count = 0;
+    
+    JsonReader* reader = json_reader_new();
+    json_reader_feed(reader, json, len);
+    json_reader_finish(reader);
+    
+    JsonToken tok;
+    int rc = -1;
+    JsonTokenType type = json_reader_next(reader, &tok);
+    if (type != JSON_TOKEN_ERROR && type != JSON_TOKEN_END &&
+        match_value(reader, &tok, &root, fields) == 0 &&
+        json_reader_next(reader, &tok) == JSON_TOKEN_END) {
+        rc = 0;
+    }
+    json_reader_free(reader);
+    return rc;
+}
@@ -0,0 +1,445 @@
+#include "../include/json.h"
+#include "../include/core.h"
+#include "../include/json_number.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#define READER_MAX_DEPTH 512
+
+// What the grammar allows next
+typedef enum {
+    EXPECT_VALUE,
+    EXPECT_FIRST_VALUE,    // value or ']' right after '['
+    EXPECT_FIRST_KEY,      // key or '}' right after '{'
+    EXPECT_KEY,
+    EXPECT_COLON,
+    EXPECT_SEPARATOR,      // ',' or the closing bracket
+    EXPECT_EOF
+} Expect;
+
+// Token being lexed when the input ran out
+typedef enum {
+    LEX_NONE,
+    LEX_STRING,
+    LEX_ESCAPE,
+    LEX_UNICODE,
+    LEX_NUMBER,
+    LEX_LITERAL,
+    LEX_SKIP               // passing over a container without tokenizing it
+} Lex;
+
+struct JsonReader {
+    const char* in;
+    size_t in_len;
+    size_t in_pos;
+    int finished;
+    int failed;
+    
+    Expect expect;
+    Lex lex;
+    int lex_key;               // string being lexed is an object key
+    
+    char* token;               // decoded string or number text
+    size_t token_len;
+    size_t token_cap;
+    
+    unsigned code;             // \uXXXX escape being read
+    int code_digits;
+    unsigned high_surrogate;   // first half of a pair, 0 if none
+    
+    const char* literal;       // "true", "false" or "null" being matched
+    size_t literal_pos;
+    
+    size_t skip_depth;         // brackets still open inside the skipped container
+    int skip_string;           // inside a string while skipping
+    int skip_escape;
+    
+    char* stack;               // '{' or '[' per open container
+    size_t depth;
+    size_t stack_cap;
+};
+
+JsonReader* json_reader_new(void) {
+    JsonReader* r = malloc_safe(sizeof(JsonReader));
+    memset(r, 0, sizeof(*r));
+    r->expect = EXPECT_VALUE;
+    return r;
+}
+
+void json_reader_free(JsonReader* r) {
+    if (!r) return;
+    free(r->token);
+    free(r->stack);
+    free(r);
+}
+
+void json_reader_feed(JsonReader* r, const char* data, size_t len) {
+    r->in = data;
+    r->in_len = len;
+    r->in_pos = 0;
+}
+
+void json_reader_finish(JsonReader* r) {
+    r->finished = 1;
+}
+
+static void token_append(JsonReader* r, const char* data, size_t len) {
+    if (r->token_len + len + 1 > r->token_cap) {
+        size_t cap = r->token_cap ? r->token_cap : 256;
+        while (r->token_len + len + 1 > cap) cap *= 2;
+        r->token = realloc(r->token, cap);
+        if (!r->token) {
+            fprintf(stderr, "Fatal: realloc failed\n");
+            exit(1);
+        }
+        r->token_cap = cap;
+    }
+    memcpy(r->token + r->token_len, data, len);
+    r->token_len += len;
+    r->token[r->token_len] = '\0';
+}
+
+static void token_clear(JsonReader* r) {
+    r->token_len = 0;
+    if (r->token) r->token[0] = '\0';
+}
+
+static void append_utf8(JsonReader* r, unsigned cp) {
+    char buf[4];
+    size_t n;
+    if (cp < 0x80) {
+        buf[0] = (char)cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        buf[0] = (char)(0xC0 | (cp >> 6));
+        buf[1] = (char)(0x80 | (cp & 0x3F));
+        n = 2;
+    } else if (cp < 0x10000) {
+        buf[0] = (char)(0xE0 | (cp >> 12));
+        buf[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        buf[2] = (char)(0x80 | (cp & 0x3F));
+        n = 3;
+    } else {
+        buf[0] = (char)(0xF0 | (cp >> 18));
+        buf[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        buf[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        buf[3] = (char)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+    token_append(r, buf, n);
+}
+
+// A high surrogate not followed by its low half becomes U+FFFD
+static void flush_surrogate(JsonReader* r) {
+    if (!r->high_surrogate) return;
+    append_utf8(r, 0xFFFD);
+    r->high_surrogate = 0;
+}
+
+static void add_code_point(JsonReader* r, unsigned cp) {
+    if (cp >= 0xDC00 && cp <= 0xDFFF && r->high_surrogate) {
+        cp = 0x10000 + ((r->high_surrogate - 0xD800) << 10) + (cp - 0xDC00);
+        r->high_surrogate = 0;
+        append_utf8(r, cp);
+        return;
+    }
+    flush_surrogate(r);
+    if (cp >= 0xD800 && cp <= 0xDBFF) {
+        r->high_surrogate = cp;
+    } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+        append_utf8(r, 0xFFFD);
+    } else {
+        append_utf8(r, cp);
+    }
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static int is_number_char(char c) {
+    return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+static JsonTokenType fail(JsonReader* r) {
+    r->failed = 1;
+    return JSON_TOKEN_ERROR;
+}
+
+static void after_value(JsonReader* r) {
+    r->expect = r->depth == 0 ? EXPECT_EOF : EXPECT_SEPARATOR;
+}
+
+static JsonTokenType open_container(JsonReader* r, char bracket, JsonToken* tok) {
+    if (r->depth == READER_MAX_DEPTH) return fail(r);
+    if (r->depth == r->stack_cap) {
+        r->stack_cap = r->stack_cap ? r->stack_cap * 2 : 16;
+        r->stack = realloc(r->stack, r->stack_cap);
+        if (!r->stack) {
+            fprintf(stderr, "Fatal: realloc failed\n");
+            exit(1);
+        }
+    }
+    tok->depth = (int)r->depth;
+    r->stack[r->depth++] = bracket;
+    r->expect = bracket == '{' ? EXPECT_FIRST_KEY : EXPECT_FIRST_VALUE;
+    tok->type = bracket == '{' ? JSON_TOKEN_OBJECT_START : JSON_TOKEN_ARRAY_START;
+    return tok->type;
+}
+
+static JsonTokenType close_container(JsonReader* r, char bracket, JsonToken* tok) {
+    char open = bracket == '}' ? '{' : '[';
+    if (r->depth == 0 || r->stack[r->depth - 1] != open) return fail(r);
+    r->depth--;
+    tok->depth = (int)r->depth;
+    after_value(r);
+    tok->type = bracket == '}' ? JSON_TOKEN_OBJECT_END : JSON_TOKEN_ARRAY_END;
+    return tok->type;
+}
+
+// The number text collected in token is complete
+static JsonTokenType number_token(JsonReader* r, JsonToken* tok) {
+    const char* end = json_number_parse(r->token, &tok->number);
+    if (!end || *end) return fail(r);
+    r->lex = LEX_NONE;
+    tok->type = JSON_TOKEN_NUMBER;
+    tok->depth = (int)r->depth;
+    after_value(r);
+    return tok->type;
+}
+
+// Continue the token in progress. Returns JSON_TOKEN_NEED_MORE if the
+// input ran out before it ended.
+static JsonTokenType lex_resume(JsonReader* r, JsonToken* tok) {
+    while (r->in_pos < r->in_len) {
+        char c = r->in[r->in_pos];
+        
+        switch (r->lex) {
+            case LEX_STRING: {
+                // Copy the plain run up to the next quote or backslash in one go
+                size_t start = r->in_pos;
+                while (r->in_pos < r->in_len) {
+                    c = r->in[r->in_pos];
+                    if (c == '"' || c == '\\' || (unsigned char)c < 0x20) break;
+                    r->in_pos++;
+                }
+                if (r->in_pos > start) {
+                    flush_surrogate(r);
+                    token_append(r, r->in + start, r->in_pos - start);
+                }
+                if (r->in_pos == r->in_len) break;
+                r->in_pos++;
+                if ((unsigned char)c < 0x20) return fail(r);
+                if (c == '\\') {
+                    r->lex = LEX_ESCAPE;
+                    break;
+                }
+                
+                flush_surrogate(r);
+                r->lex = LEX_NONE;
+                tok->string = r->token ? r->token : "";
+                tok->string_len = r->token_len;
+                tok->depth = (int)r->depth;
+                if (r->lex_key) {
+                    r->expect = EXPECT_COLON;
+                    tok->type = JSON_TOKEN_KEY;
+                } else {
+                    after_value(r);
+                    tok->type = JSON_TOKEN_STRING;
+                }
+                return tok->type;
+            }
+            
+            case LEX_ESCAPE: {
+                r->in_pos++;
+                char out;
+                switch (c) {
+                    case '"': out = '"'; break;
+                    case '\\': out = '\\'; break;
+                    case '/': out = '/'; break;
+                    case 'b': out = '\b'; break;
+                    case 'f': out = '\f'; break;
+                    case 'n': out = '\n'; break;
+                    case 'r': out = '\r'; break;
+                    case 't': out = '\t'; break;
+                    case 'u':
+                        r->lex = LEX_UNICODE;
+                        r->code = 0;
+                        r->code_digits = 0;
+                        continue;
+                    default:
+                        return fail(r);
+                }
+                flush_surrogate(r);
+                token_append(r, &out, 1);
+                r->lex = LEX_STRING;
+                break;
+            }
+            
+            case LEX_UNICODE: {
+                int digit = hex_digit(c);
+                if (digit < 0) return fail(r);
+                r->in_pos++;
+                r->code = (r->code << 4) | (unsigned)digit;
+                if (++r->code_digits == 4) {
+                    add_code_point(r, r->code);
+                    r->lex = LEX_STRING;
+                }
+                break;
+            }
+            
+            case LEX_NUMBER: {
+                size_t start = r->in_pos;
+                while (r->in_pos < r->in_len && is_number_char(r->in[r->in_pos])) r->in_pos++;
+                token_append(r, r->in + start, r->in_pos - start);
+                if (r->in_pos == r->in_len) break;
+                return number_token(r, tok);
+            }
+            
+            case LEX_SKIP: {
+                // Only quotes, escapes and brackets matter here
+                const char* p = r->in + r->in_pos;
+                const char* end = r->in + r->in_len;
+                while (p < end) {
+                    char ch = *p++;
+                    if (r->skip_string) {
+                        if (r->skip_escape) {
+                            r->skip_escape = 0;
+                        } else if (ch == '\\') {
+                            r->skip_escape = 1;
+                        } else if (ch == '"') {
+                            r->skip_string = 0;
+                        }
+                    } else if (ch == '"') {
+                        r->skip_string = 1;
+                    } else if (ch == '{' || ch == '[') {
+                        r->skip_depth++;
+                    } else if ((ch == '}' || ch == ']') && --r->skip_depth == 0) {
+                        r->in_pos = p - r->in;
+                        r->lex = LEX_NONE;
+                        return close_container(r, ch, tok);
+                    }
+                }
+                r->in_pos = r->in_len;
+                break;
+            }
+            
+            case LEX_LITERAL: {
+                if (c != r->literal[r->literal_pos]) return fail(r);
+                r->in_pos++;
+                if (r->literal[++r->literal_pos] != '\0') break;
+                
+                r->lex = LEX_NONE;
+                tok->depth = (int)r->depth;
+                after_value(r);
+                if (r->literal[0] == 'n') {
+                    tok->type = JSON_TOKEN_NULL;
+                } else {
+                    tok->type = JSON_TOKEN_BOOL;
+                    tok->bool_val = r->literal[0] == 't';
+                }
+                return tok->type;
+            }
+            
+            default:
+                return fail(r);
+        }
+    }
+    
+    // Only a number can end at the end of the input
+    if (r->lex == LEX_NUMBER && r->finished) return number_token(r, tok);
+    if (r->finished) return fail(r);
+    return JSON_TOKEN_NEED_MORE;
+}
+
+JsonTokenType json_reader_next(JsonReader* r, JsonToken* tok) {
+    if (r->failed) return JSON_TOKEN_ERROR;
+    if (r->lex != LEX_NONE) return lex_resume(r, tok);
+    
+    while (r->in_pos < r->in_len) {
+        char c = r->in[r->in_pos];
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            r->in_pos++;
+            continue;
+        }
+        
+        switch (r->expect) {
+            case EXPECT_EOF:
+                return fail(r);
+            
+            case EXPECT_COLON:
+                if (c != ':') return fail(r);
+                r->in_pos++;
+                r->expect = EXPECT_VALUE;
+                continue;
+            
+            case EXPECT_SEPARATOR:
+                r->in_pos++;
+                if (c == ',') {
+                    r->expect = r->stack[r->depth - 1] == '{' ? EXPECT_KEY : EXPECT_VALUE;
+                    continue;
+                }
+                if (c == '}' || c == ']') return close_container(r, c, tok);
+                return fail(r);
+            
+            case EXPECT_FIRST_KEY:
+                if (c == '}') {
+                    r->in_pos++;
+                    return close_container(r, c, tok);
+                }
+                // fall through
+            case EXPECT_KEY:
+                if (c != '"') return fail(r);
+                r->in_pos++;
+                r->lex = LEX_STRING;
+                r->lex_key = 1;
+                token_clear(r);
+                return lex_resume(r, tok);
+            
+            case EXPECT_FIRST_VALUE:
+                if (c == ']') {
+                    r->in_pos++;
+                    return close_container(r, c, tok);
+                }
+                // fall through
+            case EXPECT_VALUE:
+                if (c == '{' || c == '[') {
+                    r->in_pos++;
+                    return open_container(r, c, tok);
+                }
+                token_clear(r);
+                if (c == '"') {
+                    r->in_pos++;
+                    r->lex = LEX_STRING;
+                    r->lex_key = 0;
+                } else if (c == '-' || (c >= '0' && c <= '9')) {
+                    r->lex = LEX_NUMBER;
+                } else if (c == 't' || c == 'f' || c == 'n') {
+                    r->lex = LEX_LITERAL;
+                    r->literal = c == 't' ? "true" : c == 'f' ? "false" : "null";
+                    r->literal_pos = 0;
+                } else {
+                    return fail(r);
+                }
+                return lex_resume(r, tok);
+        }
+    }
+    
+    if (!r->finished) return JSON_TOKEN_NEED_MORE;
+    if (r->expect != EXPECT_EOF) return fail(r);
+    return JSON_TOKEN_END;
+}
+
+JsonTokenType json_reader_skip(JsonReader* r, JsonToken* tok) {
+    if (r->failed) return JSON_TOKEN_ERROR;
+    if (r->lex != LEX_NONE || r->depth == 0) return fail(r);
+    r->lex = LEX_SKIP;
+    r->skip_depth = 1;
+    r->skip_string = 0;
+    r->skip_escape = 0;
+    return lex_resume(r, tok);
+}
@@ -0,0 +1,555 @@
+#define _GNU_SOURCE
+#include "../include/json.h"
+#include "../include/json_number.h"
+#include "../include/core.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <locale.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+
+typedef struct {
+    char* data;
+    size_t len;
+    size_t capacity;
+} Buffer;
+
+static void buffer_reserve(Buffer* buf, size_t extra) {
+    if (buf->capacity - buf->len >= extra) return;
+    size_t capacity = buf->capacity ? buf->capacity : 256;
+    while (capacity - buf->len < extra) capacity *= 2;
+    buf->data = realloc(buf->data, capacity);
+    if (!buf->data) {
+        fprintf(stderr, "Fatal: realloc failed\n");
+        exit(1);
+    }
+    buf->capacity = capacity;
+}
+
+static void buffer_append(Buffer* buf, const void* data, size_t len) {
+    buffer_reserve(buf, len);
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+/* ---- Text --------------------------------------------------------------- */
+
+static void write_string(Buffer* buf, const char* str, size_t len) {
+    buffer_reserve(buf, len + 2);
+    buf->data[buf->len++] = '"';
+    
+    const char* run = str;
+    const char* end = str + len;
+    for (const char* p = str; p < end; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        
+        buffer_append(buf, run, (size_t)(p - run));
+        run = p + 1;
+        char escape[8];
+        switch (c) {
+            case '"': buffer_append(buf, "\\\"", 2); break;
+            case '\\': buffer_append(buf, "\\\\", 2); break;
+            case '\n': buffer_append(buf, "\\n", 2); break;
+            case '\r': buffer_append(buf, "\\r", 2); break;
+            case '\t': buffer_append(buf, "\\t", 2); break;
+            case '\b': buffer_append(buf, "\\b", 2); break;
+            case '\f': buffer_append(buf, "\\f", 2); break;
+            default:
+                snprintf(escape, sizeof(escape), "\\u%04x", c);
+                buffer_append(buf, escape, 6);
+        }
+    }
+    buffer_append(buf, run, (size_t)(end - run));
+    buffer_append(buf, "\"", 1);
+}
+
+// printf follows the thread's locale, so json_serialize switches it to C
+// while writing; a ',' or multi-byte decimal point would not be JSON
+static locale_t c_locale;
+static pthread_once_t c_locale_once = PTHREAD_ONCE_INIT;
+
+static void c_locale_create(void) {
+    c_locale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+}
+
+// Without a C locale, fold whatever separator the locale used into '.'
+static void fix_decimal_point(char* text) {
+    char* out = text;
+    for (const char* p = text; *p; ) {
+        if ((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == 'e') {
+            *out++ = *p++;
+            continue;
+        }
+        *out++ = '.';
+        while (*p && !((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == 'e')) p++;
+    }
+    *out = '\0';
+}
+
+static void write_number(Buffer* buf, double num) {
+    if (num != num || num - num != 0) {
+        buffer_append(buf, "null", 4);
+        return;
+    }
+    
+    // 15 significant digits unless more are needed to read back exactly
+    char text[32];
+    for (int precision = 15; precision <= 17; precision++) {
+        snprintf(text, sizeof(text), "%.*g", precision, num);
+        if (!c_locale) fix_decimal_point(text);
+        double back;
+        const char* end = json_number_parse(text, &back);
+        if (end && !*end && back == num) break;
+    }
+    buffer_append(buf, text, strlen(text));
+}
+
+static void write_value(Buffer* buf, const JsonValue* val) {
+    switch (val->type) {
+        case JSON_NULL:
+            buffer_append(buf, "null", 4);
+            break;
+        case JSON_BOOL:
+            if (val->data.bool_val) buffer_append(buf, "true", 4);
+            else buffer_append(buf, "false", 5);
+            break;
+        case JSON_NUMBER:
+            write_number(buf, val->data.number_val);
+            break;
+        case JSON_STRING:
+            write_string(buf, val->data.string_val, val->data.string_len);
+            break;
+        case JSON_ARRAY: {
+            const JsonArray* arr = val->data.array_val;
+            buffer_append(buf, "[", 1);
+            for (size_t i = 0; i < arr->count; i++) {
+                if (i) buffer_append(buf, ",", 1);
+                if (arr->items) write_value(buf, arr->items[i]);
+                else write_number(buf, arr->numbers[i]);
+            }
+            buffer_append(buf, "]", 1);
+            break;
+        }
+        case JSON_OBJECT: {
+            const JsonObject* obj = val->data.object_val;
+            buffer_append(buf, "{", 1);
+            for (size_t i = 0; i < obj->count; i++) {
+                if (i) buffer_append(buf, ",", 1);
+                write_string(buf, obj->keys[i], strlen(obj->keys[i]));
+                buffer_append(buf, ":", 1);
+                write_value(buf, obj->values[i]);
+            }
+            buffer_append(buf, "}", 1);
+            break;
+        }
+    }
+}
+
+char* json_serialize(const JsonValue* val, size_t* len) {
+    pthread_once(&c_locale_once, c_locale_create);
+    locale_t previous = c_locale ? uselocale(c_locale) : (locale_t)0;
+    
+    Buffer buf = { NULL, 0, 0 };
+    write_value(&buf, val);
+    if (previous) uselocale(previous);
+    buffer_append(&buf, "", 1);
+    if (len) *len = buf.len - 1;
+    return buf.data;
+}
+
+/* ---- Binary image ------------------------------------------------------- */
+
+#define IMAGE_MAGIC "WXJSONB1"
+#define IMAGE_ALIGN 16
+
+typedef struct {
+    char magic[8];
+    uint32_t pointer_size;
+    uint32_t byte_order;     // 0x01020304 as written
+    uint64_t size;           // whole image, header included
+    uint64_t base;           // address the pointers are relative to
+    uint64_t root;
+    uint64_t relocs;         // offset of the relocation table
+    uint64_t reloc_count;
+} ImageHeader;
+
+typedef struct {
+    Buffer buf;
+    Buffer relocs;           // uint64_t offsets of pointer slots
+} Image;
+
+// Zeroed space for size bytes; returns its offset
+static size_t image_alloc(Image* im, size_t size, size_t align) {
+    size_t pad = (align - im->buf.len % align) % align;
+    buffer_reserve(&im->buf, pad + size);
+    memset(im->buf.data + im->buf.len, 0, pad + size);
+    im->buf.len += pad;
+    size_t at = im->buf.len;
+    im->buf.len += size;
+    return at;
+}
+
+static size_t image_copy(Image* im, const void* data, size_t size, size_t align) {
+    size_t at = image_alloc(im, size, align);
+    if (size) memcpy(im->buf.data + at, data, size);
+    return at;
+}
+
+// Point the pointer slot at offset slot to offset target
+static void image_link(Image* im, size_t slot, size_t target) {
+    uintptr_t value = target;
+    memcpy(im->buf.data + slot, &value, sizeof(value));
+    uint64_t reloc = slot;
+    buffer_append(&im->relocs, &reloc, sizeof(reloc));
+}
+
+static size_t encode_value(Image* im, const JsonValue* val);
+
+static size_t encode_array(Image* im, const JsonArray* arr) {
+    JsonArray copy = { NULL, arr->count, NULL, NULL };
+    size_t at = image_copy(im, &copy, sizeof(copy), _Alignof(JsonArray));
+    
+    if (arr->numbers) {
+        size_t numbers = image_copy(im, arr->numbers, arr->count * sizeof(double), sizeof(double));
+        image_link(im, at + offsetof(JsonArray, numbers), numbers);
+        if (arr->nulls) {
+            size_t nulls = image_copy(im, arr->nulls, (arr->count + 7) / 8, 1);
+            image_link(im, at + offsetof(JsonArray, nulls), nulls);
+        }
+    } else if (arr->items) {
+        size_t items = image_alloc(im, arr->count * sizeof(JsonValue*), _Alignof(JsonValue*));
+        image_link(im, at + offsetof(JsonArray, items), items);
+        for (size_t i = 0; i < arr->count; i++) {
+            image_link(im, items + i * sizeof(JsonValue*), encode_value(im, arr->items[i]));
+        }
+    }
+    return at;
+}
+
+static size_t encode_object(Image* im, const JsonObject* obj) {
+    JsonObject copy = { NULL, NULL, obj->count, NULL, NULL, obj->slot_mask };
+    size_t at = image_copy(im, &copy, sizeof(copy), _Alignof(JsonObject));
+    if (obj->count == 0) return at;
+    
+    size_t keys = image_alloc(im, obj->count * sizeof(char*), _Alignof(char*));
+    size_t values = image_alloc(im, obj->count * sizeof(JsonValue*), _Alignof(JsonValue*));
+    image_link(im, at + offsetof(JsonObject, keys), keys);
+    image_link(im, at + offsetof(JsonObject, values), values);
+    for (size_t i = 0; i < obj->count; i++) {
+        size_t key = image_copy(im, obj->keys[i], strlen(obj->keys[i]) + 1, 1);
+        image_link(im, keys + i * sizeof(char*), key);
+        image_link(im, values + i * sizeof(JsonValue*), encode_value(im, obj->values[i]));
+    }
+    
+    size_t hashes = image_copy(im, obj->hashes, obj->count * sizeof(uint32_t), sizeof(uint32_t));
+    image_link(im, at + offsetof(JsonObject, hashes), hashes);
+    if (obj->slots) {
+        size_t slots = image_copy(im, obj->slots, (obj->slot_mask + 1) * sizeof(uint32_t), sizeof(uint32_t));
+        image_link(im, at + offsetof(JsonObject, slots), slots);
+    }
+    return at;
+}
+
+static size_t encode_value(Image* im, const JsonValue* val) {
+    JsonValue copy = *val;
+    if (val->type == JSON_STRING) copy.data.string_val = NULL;
+    if (val->type == JSON_ARRAY) copy.data.array_val = NULL;
+    if (val->type == JSON_OBJECT) copy.data.object_val = NULL;
+    size_t at = image_copy(im, &copy, sizeof(copy), _Alignof(JsonValue));
+    
+    if (val->type == JSON_STRING) {
+        size_t str = image_copy(im, val->data.string_val, val->data.string_len + 1, 1);
+        image_link(im, at + offsetof(JsonValue, data.string_val), str);
+    } else if (val->type == JSON_ARRAY) {
+        image_link(im, at + offsetof(JsonValue, data.array_val), encode_array(im, val->data.array_val));
+    } else if (val->type == JSON_OBJECT) {
+        image_link(im, at + offsetof(JsonValue, data.object_val), encode_object(im, val->data.object_val));
+    }
+    return at;
+}
+
+void* json_binary_encode(const JsonValue* val, size_t* len) {
+    Image im = { { NULL, 0, 0 }, { NULL, 0, 0 } };
+    image_alloc(&im, sizeof(ImageHeader), IMAGE_ALIGN);
+    size_t root = encode_value(&im, val);
+    size_t relocs = image_copy(&im, im.relocs.data, im.relocs.len, sizeof(uint64_t));
+    
+    ImageHeader header;
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+    header.pointer_size = sizeof(void*);
+    header.byte_order = 0x01020304;
+    header.size = im.buf.len;
+    header.base = 0;
+    header.root = root;
+    header.relocs = relocs;
+    header.reloc_count = im.relocs.len / sizeof(uint64_t);
+    memcpy(im.buf.data, &header, sizeof(header));
+    
+    free(im.relocs.data);
+    *len = im.buf.len;
+    return im.buf.data;
+}
+
+/* ---- Loading ------------------------------------------------------------ */
+
+#define IMAGE_MAX_DEPTH 512
+
+// Nodes may only live between the header and the relocation table. They
+// are claimed in the order json_binary_encode lays them out, each past the
+// last, so no two can overlap or be the same node. Every offset below is
+// relative to the image and checked before it is followed.
+typedef struct {
+    const char* base;
+    size_t limit;                // offset of the relocation table
+    size_t next;                 // first byte no node has claimed yet
+    uintptr_t old_base;
+    unsigned char* relocated;    // bit per pointer slot in the table
+    size_t followed;             // relocated slots the walk used
+} Loader;
+
+static int bit_test(const unsigned char* bits, size_t i) {
+    return bits[i / 8] >> (i % 8) & 1;
+}
+
+static void bit_set(unsigned char* bits, size_t i) {
+    bits[i / 8] |= (unsigned char)(1u << (i % 8));
+}
+
+// Take count items of size bytes at off for the next node: aligned, inside
+// the node area and past everything claimed before
+static int claim(Loader* ld, size_t off, size_t count, size_t size, size_t align) {
+    if (off < ld->next || off % align != 0 || off > ld->limit ||
+        count > (ld->limit - off) / size) {
+        return 0;
+    }
+    ld->next = off + count * size;
+    return 1;
+}
+
+// Read the pointer slot at slot: 1 with *target = 0 for NULL, 1 with the
+// target's offset for a relocated pointer, 0 if the slot is not sound.
+// Slots belong to claimed nodes, so none is followed twice and a cycle
+// runs into a node that is already claimed.
+static int follow(Loader* ld, size_t slot, size_t* target) {
+    uintptr_t value;
+    memcpy(&value, ld->base + slot, sizeof(value));
+    if (!bit_test(ld->relocated, slot / sizeof(uintptr_t))) {
+        *target = 0;
+        return value == 0;
+    }
+    ld->followed++;
+    
+    uintptr_t off = value - ld->old_base;
+    if (off < sizeof(ImageHeader) || off > ld->limit) return 0;
+    *target = off;
+    return 1;
+}
+
+static int check_value(Loader* ld, size_t at, int depth);
+
+static int check_array(Loader* ld, size_t at, int depth) {
+    if (!claim(ld, at, 1, sizeof(JsonArray), _Alignof(JsonArray))) return 0;
+    JsonArray arr;
+    memcpy(&arr, ld->base + at, sizeof(arr));
+    size_t items, numbers, nulls;
+    if (!follow(ld, at + offsetof(JsonArray, items), &items) ||
+        !follow(ld, at + offsetof(JsonArray, numbers), &numbers) ||
+        !follow(ld, at + offsetof(JsonArray, nulls), &nulls)) {
+        return 0;
+    }
+    
+    if (numbers) {
+        if (items || !claim(ld, numbers, arr.count, sizeof(double), sizeof(double))) return 0;
+        return !nulls || claim(ld, nulls, (arr.count + 7) / 8, 1, 1);
+    }
+    if (nulls) return 0;
+    if (!items) return arr.count == 0;
+    
+    if (!claim(ld, items, arr.count, sizeof(JsonValue*), _Alignof(JsonValue*))) return 0;
+    for (size_t i = 0; i < arr.count; i++) {
+        size_t item;
+        if (!follow(ld, items + i * sizeof(JsonValue*), &item) || !item ||
+            !check_value(ld, item, depth + 1)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// A NUL-terminated string at off
+static int check_key(Loader* ld, size_t off) {
+    if (off < ld->next || off >= ld->limit) return 0;
+    const char* end = memchr(ld->base + off, '\0', ld->limit - off);
+    return end && claim(ld, off, (size_t)(end - (ld->base + off)) + 1, 1, 1);
+}
+
+static int check_object(Loader* ld, size_t at, int depth) {
+    if (!claim(ld, at, 1, sizeof(JsonObject), _Alignof(JsonObject))) return 0;
+    JsonObject obj;
+    memcpy(&obj, ld->base + at, sizeof(obj));
+    size_t keys, values, hashes, slots;
+    if (!follow(ld, at + offsetof(JsonObject, keys), &keys) ||
+        !follow(ld, at + offsetof(JsonObject, values), &values) ||
+        !follow(ld, at + offsetof(JsonObject, hashes), &hashes) ||
+        !follow(ld, at + offsetof(JsonObject, slots), &slots)) {
+        return 0;
+    }
+    if (obj.count == 0) return !keys && !values && !hashes && !slots;
+    
+    if (!claim(ld, keys, obj.count, sizeof(char*), _Alignof(char*)) ||
+        !claim(ld, values, obj.count, sizeof(JsonValue*), _Alignof(JsonValue*))) {
+        return 0;
+    }
+    for (size_t i = 0; i < obj.count; i++) {
+        size_t key, value;
+        if (!follow(ld, keys + i * sizeof(char*), &key) || !check_key(ld, key) ||
+            !follow(ld, values + i * sizeof(JsonValue*), &value) || !value ||
+            !check_value(ld, value, depth + 1)) {
+            return 0;
+        }
+    }
+    if (!claim(ld, hashes, obj.count, sizeof(uint32_t), sizeof(uint32_t))) return 0;
+    
+    if (!slots) return 1;
+    // Lookups probe until an empty slot, so there must be one
+    if (obj.slot_mask >= ld->limit / sizeof(uint32_t) ||
+        !claim(ld, slots, obj.slot_mask + 1, sizeof(uint32_t), sizeof(uint32_t))) {
+        return 0;
+    }
+    int empty = 0;
+    for (size_t i = 0; i <= obj.slot_mask; i++) {
+        uint32_t entry;
+        memcpy(&entry, ld->base + slots + i * sizeof(entry), sizeof(entry));
+        if (entry > obj.count) return 0;
+        empty |= entry == 0;
+    }
+    return empty;
+}
+
+static int check_value(Loader* ld, size_t at, int depth) {
+    if (depth > IMAGE_MAX_DEPTH || !claim(ld, at, 1, sizeof(JsonValue), _Alignof(JsonValue))) return 0;
+    JsonValue val;
+    memcpy(&val, ld->base + at, sizeof(val));
+    size_t target;
+    
+    switch (val.type) {
+        case JSON_NULL:
+        case JSON_BOOL:
+        case JSON_NUMBER:
+            return 1;
+        case JSON_STRING:
+            if (!follow(ld, at + offsetof(JsonValue, data.string_val), &target) || !target ||
+                val.data.string_len >= ld->limit - target ||
+                ld->base[target + val.data.string_len] != '\0') {
+                return 0;
+            }
+            return claim(ld, target, val.data.string_len + 1, 1, 1);
+        case JSON_ARRAY:
+            return follow(ld, at + offsetof(JsonValue, data.array_val), &target) && target &&
+                   check_array(ld, target, depth);
+        case JSON_OBJECT:
+            return follow(ld, at + offsetof(JsonValue, data.object_val), &target) && target &&
+                   check_object(ld, target, depth);
+    }
+    return 0;
+}
+
+// The relocation table must list exactly the pointer slots of the tree
+// under the root, each once, so rebasing touches nothing else
+static int check_image(const ImageHeader* header, const char* base) {
+    Loader ld;
+    ld.base = base;
+    ld.limit = header->relocs;
+    ld.next = sizeof(ImageHeader);
+    ld.old_base = (uintptr_t)header->base;
+    ld.followed = 0;
+    
+    // Small images, like a forecast, need no allocation
+    unsigned char bits[512];
+    size_t size = ld.limit / sizeof(uintptr_t) / 8 + 1;
+    ld.relocated = size <= sizeof(bits) ? bits : malloc_safe(size);
+    memset(ld.relocated, 0, size);
+    
+    int ok = 1;
+    const uint64_t* relocs = (const uint64_t*)(base + header->relocs);
+    for (uint64_t i = 0; i < header->reloc_count && ok; i++) {
+        uint64_t slot = relocs[i];
+        ok = slot >= sizeof(ImageHeader) && slot % sizeof(uintptr_t) == 0 &&
+             slot <= ld.limit - sizeof(uintptr_t) &&
+             !bit_test(ld.relocated, slot / sizeof(uintptr_t));
+        if (ok) bit_set(ld.relocated, slot / sizeof(uintptr_t));
+    }
+    if (ok) ok = check_value(&ld, header->root, 0) && ld.followed == header->reloc_count;
+    
+    if (ld.relocated != bits) free(ld.relocated);
+    return ok;
+}
+
+JsonValue* json_binary_load(void* image, size_t len) {
+    ImageHeader* header = image;
+    if (len < sizeof(ImageHeader) || (uintptr_t)image % IMAGE_ALIGN != 0) return NULL;
+    if (memcmp(header->magic, IMAGE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->pointer_size != sizeof(void*) || header->byte_order != 0x01020304 ||
+        header->size != len || header->relocs < sizeof(ImageHeader) || header->relocs > len ||
+        header->relocs % sizeof(uint64_t) != 0 ||
+        header->reloc_count != (len - header->relocs) / sizeof(uint64_t) ||
+        (len - header->relocs) % sizeof(uint64_t) != 0) {
+        return NULL;
+    }
+    
+    // Check everything before changing anything
+    char* base = image;
+    if (!check_image(header, base)) return NULL;
+    
+    uintptr_t delta = (uintptr_t)base - (uintptr_t)header->base;
+    if (delta) {
+        const uint64_t* relocs = (const uint64_t*)(base + header->relocs);
+        for (uint64_t i = 0; i < header->reloc_count; i++) {
+            *(uintptr_t*)(base + relocs[i]) += delta;
+        }
+        header->base = (uintptr_t)base;
+    }
+    return (JsonValue*)(base + header->root);
+}
+
+JsonValue* json_binary_map(const char* path, JsonMapping* map) {
+    map->addr = NULL;
+    map->len = 0;
+    
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+        close(fd);
+        return NULL;
+    }
+    
+    void* addr = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) return NULL;
+    
+    JsonValue* root = json_binary_load(addr, (size_t)st.st_size);
+    if (!root) {
+        munmap(addr, (size_t)st.st_size);
+        return NULL;
+    }
+    map->addr = addr;
+    map->len = (size_t)st.st_size;
+    return root;
+}
+
+void json_binary_unmap(JsonMapping* map) {
+    if (map->addr) munmap(map->addr, map->len);
+    map->addr = NULL;
+    map->len = 0;
+}
@@ -4,6 +4,7 @@
 #include "../include/weather.h"
 #include "../include/ui.h"
 #include "../include/tui.h"
+#include "../include/http.h"
 
 #define VERSION "1.0.0"
 
@@ -11,6 +12,7 @@ static void print_help(void) {
     printf("\nSupreme Weather Forecast CLI 🌤️  (Pure C Edition)\n\n");
     printf("USAGE:\n");
     printf("    weather-cli [CITY]\n");
+    printf("    weather-cli --coords LAT,LON\n");
     printf("    weather-cli --tui\n");
     printf("    weather-cli --help\n");
     printf("    weather-cli --version\n\n");
@@ -18,7 +20,8 @@ static void print_help(void) {
     printf("FLAGS:\n");
     printf("    -h, --help       Prints help information\n");
     printf("    -v, --version    Prints version information\n");
-    printf("    --tui            Launch interactive TUI mode\n\n");
+    printf("    --tui            Launch interactive TUI mode\n");
+    printf("    --coords LAT,LON Forecast for a position, e.g. --coords 52.52,13.41\n\n");
 }
 
 static void interactive_mode(void) {
@@ -66,7 +69,37 @@ static void interactive_mode(void) {
     }
 }
 
+// Parse "LAT,LON" in degrees; -1 if malformed or out of range
+static int parse_coords(const char* text, Latitude* lat, Longitude* lon) {
+    char* end;
+    lat->value = strtod(text, &end);
+    if (end == text || *end != ',') return -1;
+    const char* rest = end + 1;
+    lon->value = strtod(rest, &end);
+    if (end == rest || *end != '\0') return -1;
+    if (!(lat->value >= -90.0 && lat->value <= 90.0) ||
+        !(lon->value >= -180.0 && lon->value <= 180.0)) return -1;
+    return 0;
+}
+
+static int show_forecast(Location* loc) {
+    Forecast* fc = get_forecast(loc);
+    if (!fc) {
+        fprintf(stderr, "\x1b[31mError:\x1b[0m Failed to get forecast\n");
+        location_free(loc);
+        return 1;
+    }
+    
+    print_forecast(fc);
+    
+    forecast_free(fc);
+    location_free(loc);
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
+    atexit(http_cleanup);
+    
     if (argc > 1) {
         if (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0) {
             print_help();
@@ -83,6 +116,18 @@ int main(int argc, char* argv[]) {
             return 0;
         }
         
+        // Coordinates are named locally, so only the forecast is fetched
+        if (strcmp(argv[1], "--coords") == 0 || strncmp(argv[1], "--coords=", 9) == 0) {
+            const char* text = argv[1][8] == '=' ? argv[1] + 9 : argc > 2 ? argv[2] : "";
+            Latitude lat;
+            Longitude lon;
+            if (parse_coords(text, &lat, &lon) < 0) {
+                fprintf(stderr, "\x1b[31mError:\x1b[0m Expected --coords LAT,LON in degrees\n");
+                return 1;
+            }
+            return show_forecast(find_nearest_location(lat, lon));
+        }
+        
         // Direct city lookup
         const char* city = argv[1];
         
@@ -92,19 +137,7 @@ int main(int argc, char* argv[]) {
             return 1;
         }
         
-        Forecast* fc = get_forecast(loc);
-        if (!fc) {
-            fprintf(stderr, "\x1b[31mError:\x1b[0m Failed to get forecast\n");
-            location_free(loc);
-            return 1;
-        }
-        
-        print_forecast(fc);
-        
-        forecast_free(fc);
-        location_free(loc);
-        
-        return 0;
+        return show_forecast(loc);
     }
     
     // No arguments - start interactive mode
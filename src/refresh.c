@@ -0,0 +1,179 @@
+#include "../include/refresh.h"
+#include "../include/forecast_cache.h"
+#include "../include/core.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+typedef struct Watch {
+    Location location;       // own copy
+    time_t due;
+    int busy;                // a refresh is running
+    struct Watch* next;
+} Watch;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_t thread;
+static int running;
+static int stopping;
+static RefreshFn refresh_fn;
+static time_t refresh_cadence;
+static Watch* watches;
+static unsigned int jitter_seed;
+
+time_t refresh_lead(time_t cadence) {
+    return REFRESH_LEAD < cadence ? REFRESH_LEAD : cadence / 2;
+}
+
+time_t refresh_due_after(time_t now, time_t cadence, unsigned int* seed) {
+    // Inside a lead the coming update is already covered, so aim at the
+    // one after it
+    time_t lead = refresh_lead(cadence);
+    time_t expiry = forecast_cache_expiry(now + lead, cadence);
+    return lead ? expiry - 1 - (time_t)(rand_r(seed) % lead) : expiry;
+}
+
+static int same_place(const Location* a, const Location* b) {
+    return a->lat.value == b->lat.value && a->lon.value == b->lon.value;
+}
+
+// Caller holds lock
+static Watch* find_watch(const Location* location) {
+    for (Watch* w = watches; w; w = w->next) {
+        if (same_place(&w->location, location)) return w;
+    }
+    return NULL;
+}
+
+static void* scheduler(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&lock);
+    
+    while (!stopping) {
+        Watch* next = NULL;
+        for (Watch* w = watches; w; w = w->next) {
+            if (!w->busy && (!next || w->due < next->due)) next = w;
+        }
+        
+        time_t now = time(NULL);
+        if (!next) {
+            pthread_cond_wait(&wake, &lock);
+            continue;
+        }
+        if (next->due > now) {
+            struct timespec until = { next->due, 0 };
+            pthread_cond_timedwait(&wake, &lock, &until);
+            continue;
+        }
+        
+        // Refresh a private copy so unwatching meanwhile is safe
+        Location copy = next->location;
+        copy.name = strdup_safe(next->location.name);
+        copy.country = strdup_safe(next->location.country);
+        next->busy = 1;
+        pthread_mutex_unlock(&lock);
+        
+        int rc = refresh_fn(&copy);
+        
+        pthread_mutex_lock(&lock);
+        Watch* w = find_watch(&copy);
+        if (w) {
+            w->busy = 0;
+            w->due = rc == 0 ? refresh_due_after(time(NULL), refresh_cadence, &jitter_seed) : time(NULL) + REFRESH_RETRY;
+        }
+        free(copy.name);
+        free(copy.country);
+    }
+    
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+int refresh_start(RefreshFn fn, time_t cadence) {
+    pthread_mutex_lock(&lock);
+    int rc = 0;
+    if (!running) {
+        refresh_fn = fn;
+        refresh_cadence = cadence > 0 ? cadence : FORECAST_MODEL_CADENCE;
+        stopping = 0;
+        jitter_seed = (unsigned int)time(NULL) ^ (unsigned int)getpid();
+        rc = pthread_create(&thread, NULL, scheduler, NULL) == 0 ? 0 : -1;
+        running = rc == 0;
+    }
+    pthread_mutex_unlock(&lock);
+    return rc;
+}
+
+void refresh_stop(void) {
+    pthread_mutex_lock(&lock);
+    if (!running) {
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    stopping = 1;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+    
+    // Waits out a refresh already in flight
+    pthread_join(thread, NULL);
+    
+    pthread_mutex_lock(&lock);
+    while (watches) {
+        Watch* next = watches->next;
+        free(watches->location.name);
+        free(watches->location.country);
+        free(watches);
+        watches = next;
+    }
+    running = 0;
+    pthread_mutex_unlock(&lock);
+}
+
+void refresh_watch(const Location* location) {
+    pthread_mutex_lock(&lock);
+    if (!find_watch(location)) {
+        Watch* w = malloc_safe(sizeof(Watch));
+        w->location = *location;
+        w->location.name = strdup_safe(location->name);
+        w->location.country = strdup_safe(location->country);
+        w->due = refresh_due_after(time(NULL), refresh_cadence, &jitter_seed);
+        w->busy = 0;
+        w->next = watches;
+        watches = w;
+        pthread_cond_signal(&wake);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void refresh_unwatch(const Location* location) {
+    pthread_mutex_lock(&lock);
+    for (Watch** link = &watches; *link; link = &(*link)->next) {
+        Watch* w = *link;
+        if (!same_place(&w->location, location)) continue;
+        *link = w->next;
+        free(w->location.name);
+        free(w->location.country);
+        free(w);
+        break;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+int refresh_watching(const Location* location) {
+    pthread_mutex_lock(&lock);
+    int watching = running && find_watch(location) != NULL;
+    pthread_mutex_unlock(&lock);
+    return watching;
+}
+
+void refresh_revalidate(const Location* location) {
+    pthread_mutex_lock(&lock);
+    Watch* w = find_watch(location);
+    if (w && !w->busy) {
+        w->due = time(NULL);
+        pthread_cond_signal(&wake);
+    }
+    pthread_mutex_unlock(&lock);
+}
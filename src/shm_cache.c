@@ -0,0 +1,290 @@
+#include "../include/shm_cache.h"
+#include "../include/core.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SHM_MAGIC "WXSHM001"
+#define SHM_SLOTS 1024               // power of two
+#define SHM_PROBE_LIMIT 8
+#define SHM_MAX_DAYS 16
+#define SHM_KEY_MAX 96
+#define SHM_NAME_MAX 64
+#define SHM_DATE_MAX 16
+#define SHM_READ_RETRIES 64
+
+enum { SLOT_EMPTY, SLOT_READY, SLOT_FETCHING };
+
+typedef struct {
+    char magic[8];
+    uint32_t slot_size;              // guards against layout changes
+    uint32_t slot_count;
+} ShmHeader;
+
+typedef struct {
+    char date[SHM_DATE_MAX];
+    int32_t weather_code;
+    int32_t reserved;
+    double max_temp;
+    double min_temp;
+} ShmDay;
+
+// seq is odd while a writer is inside the slot. A READY slot holds a
+// forecast until expires; a FETCHING slot is a claim held until then.
+typedef struct {
+    _Atomic uint32_t seq;
+    uint32_t hash;
+    uint32_t state;
+    uint32_t daily_count;
+    int64_t expires;
+    double lat;
+    double lon;
+    char key[SHM_KEY_MAX];
+    char name[SHM_NAME_MAX];
+    char country[SHM_NAME_MAX];
+    ShmDay days[SHM_MAX_DAYS];
+} ShmSlot;
+
+struct ShmCache {
+    int fd;
+    void* map;
+    ShmSlot* slots;
+    pthread_mutex_t write_lock;      // flock doesn't exclude threads sharing fd
+};
+
+#define SHM_SEGMENT_SIZE (sizeof(ShmSlot) * (SHM_SLOTS + 1))
+
+static uint32_t hash_key(const char* key) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)key; *p; p++) {
+        h = (h ^ *p) * 16777619u;
+    }
+    return h;
+}
+
+static int header_valid(const ShmHeader* header) {
+    return memcmp(header->magic, SHM_MAGIC, sizeof(header->magic)) == 0 &&
+           header->slot_size == sizeof(ShmSlot) && header->slot_count == SHM_SLOTS;
+}
+
+ShmCache* shm_cache_open(const char* name) {
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) return NULL;
+    
+    // Whoever gets here first lays the segment out
+    flock(fd, LOCK_EX);
+    struct stat st;
+    int ok = fstat(fd, &st) == 0;
+    if (ok && (size_t)st.st_size != SHM_SEGMENT_SIZE) {
+        ok = ftruncate(fd, 0) == 0 && ftruncate(fd, SHM_SEGMENT_SIZE) == 0;
+    }
+    void* map = ok ? mmap(NULL, SHM_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (map != MAP_FAILED && !header_valid(map)) {
+        memset(map, 0, SHM_SEGMENT_SIZE);
+        ShmHeader* header = map;
+        memcpy(header->magic, SHM_MAGIC, sizeof(header->magic));
+        header->slot_size = sizeof(ShmSlot);
+        header->slot_count = SHM_SLOTS;
+    }
+    flock(fd, LOCK_UN);
+    
+    if (map == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    
+    ShmCache* cache = malloc_safe(sizeof(ShmCache));
+    cache->fd = fd;
+    cache->map = map;
+    cache->slots = (ShmSlot*)map + 1;    // slot 0's space holds the header
+    pthread_mutex_init(&cache->write_lock, NULL);
+    return cache;
+}
+
+void shm_cache_close(ShmCache* cache) {
+    if (!cache) return;
+    munmap(cache->map, SHM_SEGMENT_SIZE);
+    close(cache->fd);
+    pthread_mutex_destroy(&cache->write_lock);
+    free(cache);
+}
+
+int shm_cache_unlink(const char* name) {
+    return shm_unlink(name);
+}
+
+/* ---- Reading ------------------------------------------------------------ */
+
+// Consistent copy of a slot; 0 if writers kept it busy
+static int slot_read(ShmSlot* slot, ShmSlot* copy) {
+    for (int attempt = 0; attempt < SHM_READ_RETRIES; attempt++) {
+        uint32_t before = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (before & 1) {
+            // Let the writer, possibly preempted mid-update, finish
+            sched_yield();
+            continue;
+        }
+        memcpy((char*)copy + sizeof(copy->seq), (char*)slot + sizeof(slot->seq),
+               sizeof(ShmSlot) - sizeof(slot->seq));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == before) return 1;
+    }
+    return 0;
+}
+
+static Forecast* slot_forecast(ShmSlot* slot) {
+    slot->name[SHM_NAME_MAX - 1] = '\0';
+    slot->country[SHM_NAME_MAX - 1] = '\0';
+    size_t count = slot->daily_count <= SHM_MAX_DAYS ? slot->daily_count : SHM_MAX_DAYS;
+    
+    Forecast* fc = malloc_safe(sizeof(Forecast));
+    fc->location.lat.value = slot->lat;
+    fc->location.lon.value = slot->lon;
+    fc->location.name = strdup_safe(slot->name);
+    fc->location.country = strdup_safe(slot->country);
+    fc->daily_count = count;
+    fc->daily = malloc_safe((count ? count : 1) * sizeof(DailyForecast));
+    for (size_t i = 0; i < count; i++) {
+        slot->days[i].date[SHM_DATE_MAX - 1] = '\0';
+        fc->daily[i].date = strdup_safe(slot->days[i].date);
+        fc->daily[i].weather_code = slot->days[i].weather_code;
+        fc->daily[i].max_temp.value = slot->days[i].max_temp;
+        fc->daily[i].min_temp.value = slot->days[i].min_temp;
+    }
+    return fc;
+}
+
+Forecast* shm_cache_get(ShmCache* cache, const char* key, time_t now) {
+    if (!cache || strlen(key) >= SHM_KEY_MAX) return NULL;
+    uint32_t hash = hash_key(key);
+    
+    for (uint32_t i = 0; i < SHM_PROBE_LIMIT; i++) {
+        ShmSlot copy;
+        if (!slot_read(&cache->slots[(hash + i) & (SHM_SLOTS - 1)], &copy)) continue;
+        if (copy.state == SLOT_EMPTY) break;
+        if (copy.hash != hash || strncmp(copy.key, key, SHM_KEY_MAX) != 0) continue;
+        if (copy.state != SLOT_READY || copy.expires <= now) return NULL;
+        return slot_forecast(&copy);
+    }
+    return NULL;
+}
+
+/* ---- Writing ------------------------------------------------------------ */
+
+// The slot holding key, else the first empty one, else the one expiring
+// soonest in the probe window. Caller holds the write locks.
+static ShmSlot* slot_for(ShmCache* cache, const char* key, uint32_t hash) {
+    ShmSlot* soonest = NULL;
+    for (uint32_t i = 0; i < SHM_PROBE_LIMIT; i++) {
+        ShmSlot* slot = &cache->slots[(hash + i) & (SHM_SLOTS - 1)];
+        if (slot->state == SLOT_EMPTY ||
+            (slot->hash == hash && strncmp(slot->key, key, SHM_KEY_MAX) == 0)) {
+            return slot;
+        }
+        if (!soonest || slot->expires < soonest->expires) soonest = slot;
+    }
+    return soonest;
+}
+
+static void lock_writers(ShmCache* cache) {
+    pthread_mutex_lock(&cache->write_lock);
+    flock(cache->fd, LOCK_EX);
+}
+
+static void unlock_writers(ShmCache* cache) {
+    flock(cache->fd, LOCK_UN);
+    pthread_mutex_unlock(&cache->write_lock);
+}
+
+// Bracket a slot update; a writer that died inside left seq odd, which
+// the next one simply carries on from
+static uint32_t begin_write(ShmSlot* slot) {
+    uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed) | 1;
+    atomic_store_explicit(&slot->seq, seq, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    return seq;
+}
+
+static void end_write(ShmSlot* slot, uint32_t seq) {
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_release);
+}
+
+static void set_key(ShmSlot* slot, const char* key, uint32_t hash) {
+    slot->hash = hash;
+    memset(slot->key, 0, sizeof(slot->key));
+    strcpy(slot->key, key);
+}
+
+void shm_cache_put(ShmCache* cache, const char* key, const Forecast* fc, time_t expires) {
+    if (!cache || strlen(key) >= SHM_KEY_MAX) return;
+    uint32_t hash = hash_key(key);
+    
+    lock_writers(cache);
+    ShmSlot* slot = slot_for(cache, key, hash);
+    uint32_t seq = begin_write(slot);
+    
+    set_key(slot, key, hash);
+    slot->expires = expires;
+    slot->lat = fc->location.lat.value;
+    slot->lon = fc->location.lon.value;
+    snprintf(slot->name, sizeof(slot->name), "%s", fc->location.name);
+    snprintf(slot->country, sizeof(slot->country), "%s", fc->location.country);
+    slot->daily_count = fc->daily_count < SHM_MAX_DAYS ? (uint32_t)fc->daily_count : SHM_MAX_DAYS;
+    memset(slot->days, 0, sizeof(slot->days));
+    for (uint32_t i = 0; i < slot->daily_count; i++) {
+        snprintf(slot->days[i].date, sizeof(slot->days[i].date), "%s", fc->daily[i].date);
+        slot->days[i].weather_code = fc->daily[i].weather_code;
+        slot->days[i].max_temp = fc->daily[i].max_temp.value;
+        slot->days[i].min_temp = fc->daily[i].min_temp.value;
+    }
+    slot->state = SLOT_READY;
+    
+    end_write(slot, seq);
+    unlock_writers(cache);
+}
+
+int shm_cache_claim(ShmCache* cache, const char* key, time_t now) {
+    if (!cache || strlen(key) >= SHM_KEY_MAX) return 1;
+    uint32_t hash = hash_key(key);
+    
+    lock_writers(cache);
+    ShmSlot* slot = slot_for(cache, key, hash);
+    int held = slot->hash == hash && strncmp(slot->key, key, SHM_KEY_MAX) == 0 &&
+               slot->state != SLOT_EMPTY && slot->expires > now;
+    if (!held) {
+        uint32_t seq = begin_write(slot);
+        set_key(slot, key, hash);
+        slot->expires = now + SHM_CACHE_LEASE;
+        slot->daily_count = 0;
+        slot->state = SLOT_FETCHING;
+        end_write(slot, seq);
+    }
+    unlock_writers(cache);
+    return !held;
+}
+
+void shm_cache_release(ShmCache* cache, const char* key) {
+    if (!cache || strlen(key) >= SHM_KEY_MAX) return;
+    uint32_t hash = hash_key(key);
+    
+    // The slot stays FETCHING so probe chains through it hold, but expired,
+    // so the next claim succeeds at once
+    lock_writers(cache);
+    ShmSlot* slot = slot_for(cache, key, hash);
+    if (slot->hash == hash && strncmp(slot->key, key, SHM_KEY_MAX) == 0 &&
+        slot->state == SLOT_FETCHING) {
+        uint32_t seq = begin_write(slot);
+        slot->expires = 0;
+        end_write(slot, seq);
+    }
+    unlock_writers(cache);
+}
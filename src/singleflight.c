@@ -0,0 +1,58 @@
+#include "../include/singleflight.h"
+#include <string.h>
+
+struct FlightCall {
+    const char* key;           // owned by the leader, valid while in flight
+    void* result;
+    int finished;
+    int waiters;               // callers still to take their copy
+    struct FlightCall* next;
+};
+
+static struct FlightCall** find_call(FlightGroup* group, const char* key) {
+    struct FlightCall** link = &group->calls;
+    while (*link && strcmp((*link)->key, key) != 0) link = &(*link)->next;
+    return link;
+}
+
+void* flight_do(FlightGroup* group, const char* key, FlightFn fn, void* arg,
+                FlightCopyFn copy, int* shared) {
+    pthread_mutex_lock(&group->lock);
+    
+    struct FlightCall* call = *find_call(group, key);
+    if (call) {
+        call->waiters++;
+        while (!call->finished) pthread_cond_wait(&group->done, &group->lock);
+        pthread_mutex_unlock(&group->lock);
+        
+        // The leader keeps the result alive until every waiter has its copy
+        void* result = call->result ? copy(call->result) : NULL;
+        
+        pthread_mutex_lock(&group->lock);
+        call->waiters--;
+        if (call->waiters == 0) pthread_cond_broadcast(&group->done);
+        pthread_mutex_unlock(&group->lock);
+        
+        if (shared) *shared = 1;
+        return result;
+    }
+    
+    // Lead the call; the record lives on this stack frame
+    struct FlightCall self = { key, NULL, 0, 0, group->calls };
+    group->calls = &self;
+    pthread_mutex_unlock(&group->lock);
+    
+    void* result = fn(arg);
+    
+    pthread_mutex_lock(&group->lock);
+    // Later arrivals start a fresh call instead of joining this one
+    *find_call(group, key) = self.next;
+    self.result = result;
+    self.finished = 1;
+    pthread_cond_broadcast(&group->done);
+    while (self.waiters > 0) pthread_cond_wait(&group->done, &group->lock);
+    pthread_mutex_unlock(&group->lock);
+    
+    if (shared) *shared = 0;
+    return result;
+}
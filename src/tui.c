@@ -2,6 +2,7 @@
 #include "../include/weather.h"
 #include "../include/ui.h"
 #include "../include/core.h"
+#include "../include/refresh.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -107,6 +108,9 @@ void launch_tui(void) {
     Forecast* current_forecast = NULL;
     char* current_city = NULL;
     
+    // Cities looked up here stay fresh, so asking again never waits
+    refresh_start(forecast_refresh, forecast_cadence());
+    
     render_dashboard(search_query, NULL, NULL);
     
     while (1) {
@@ -129,6 +133,7 @@ void launch_tui(void) {
                 if (loc) {
                     if (current_forecast) forecast_free(current_forecast);
                     current_forecast = get_forecast(loc); // get_forecast(Location*)
+                    if (current_forecast) refresh_watch(loc);
                     
                     if (current_city) free(current_city);
                     current_city = strdup_safe(loc->name);
@@ -157,6 +162,7 @@ void launch_tui(void) {
         }
     }
     
+    refresh_stop();
     if (current_forecast) forecast_free(current_forecast);
     if (current_city) free(current_city);
     printf(CLEAR_SCREEN CURSOR_HOME SHOW_CURSOR);
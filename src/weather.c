@@ -1,12 +1,30 @@
 #include "../include/weather.h"
 #include "../include/http.h"
 #include "../include/json.h"
+#include "../include/singleflight.h"
+#include "../include/geocache.h"
+#include "../include/forecast_cache.h"
+#include "../include/shm_cache.h"
+#include "../include/gazetteer.h"
+#include "../include/grid.h"
+#include "../include/refresh.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
 
 #define GEOCODING_API "http://geocoding-api.open-meteo.com/v1/search"
 #define FORECAST_API "http://api.open-meteo.com/v1/forecast"
+#define FORECAST_DAILY "weathercode,temperature_2m_max,temperature_2m_min"
+
+// Either endpoint can be pointed at a mirror or a self-hosted instance
+static const char* api_url(const char* env, const char* fallback) {
+    const char* url = getenv(env);
+    return url && *url ? url : fallback;
+}
 
 static char* url_encode(const char* str) {
     size_t len = strlen(str);
@@ -27,91 +45,191 @@ static char* url_encode(const char* str) {
     return encoded;
 }
 
-Location* find_location(const char* city) {
-    char* encoded_city = url_encode(city);
-    char url[512];
-    snprintf(url, sizeof(url), "%s?name=%s&count=1&language=en&format=json",
-             GEOCODING_API, encoded_city);
-    free(encoded_city);
-    
-    char* response = http_get(url);
+// What a coalesced lookup needs; the URL doubles as the flight key
+typedef struct {
+    const char* url;
+    const char* city;
+    Location* location;
+} WeatherQuery;
+
+// Only a handful of fields are read from each response. The paths are
+// compiled once and matched straight off the response text.
+#define FORECAST_MAX_DAYS 16
+#define FIELD_WIDTH 128
+#define DATE_WIDTH 16
+
+static const char* const location_paths[] = {
+    "results[0].latitude",
+    "results[0].longitude",
+    "results[0].name",
+    "results[0].country",
+};
+
+static const char* const forecast_paths[] = {
+    "daily.time[*]",
+    "daily.weather_code[*]",
+    "daily.weathercode[*]",
+    "daily.temperature_2m_max[*]",
+    "daily.temperature_2m_min[*]",
+};
+
+static JsonQuery* location_query;
+static JsonQuery* forecast_query;
+static pthread_once_t queries_once = PTHREAD_ONCE_INIT;
+
+static void compile_queries(void) {
+    location_query = json_query_compile(location_paths, 4);
+    forecast_query = json_query_compile(forecast_paths, 5);
+}
+
+static FlightGroup location_flights = FLIGHT_GROUP_INIT;
+static FlightGroup forecast_flights = FLIGHT_GROUP_INIT;
+
+static void* copy_location(const void* result) {
+    const Location* src = result;
+    Location* loc = malloc_safe(sizeof(Location));
+    *loc = *src;
+    loc->name = strdup_safe(src->name);
+    loc->country = strdup_safe(src->country);
+    return loc;
+}
+
+static void* copy_forecast(const void* result) {
+    return forecast_copy(result);
+}
+
+static void* fetch_location(void* arg) {
+    const WeatherQuery* query = arg;
+    const char* city = query->city;
+    char* response = http_get(query->url);
     if (!response) {
         fprintf(stderr, "Failed to fetch location\n");
         return NULL;
     }
     
-    JsonValue* json = json_parse(response);
+    double lat, lon;
+    char name[FIELD_WIDTH], country[FIELD_WIDTH];
+    JsonQueryField fields[4] = {
+        { JSON_QUERY_NUMBER, &lat, 1, 0, 0 },
+        { JSON_QUERY_NUMBER, &lon, 1, 0, 0 },
+        { JSON_QUERY_STRING, name, 1, sizeof(name), 0 },
+        { JSON_QUERY_STRING, country, 1, sizeof(country), 0 },
+    };
+    
+    pthread_once(&queries_once, compile_queries);
+    int rc = json_query_run(location_query, response, strlen(response), fields);
     free(response);
     
-    if (!json) {
+    if (rc < 0) {
         fprintf(stderr, "Failed to parse JSON\n");
         return NULL;
     }
-    
-    JsonValue* results = json_object_get(json, "results");
-    JsonArray* arr = json_as_array(results);
-    
-    if (!arr || arr->count == 0) {
+    if (fields[0].count == 0) {
         fprintf(stderr, "Location not found: %s\n", city);
-        json_free(json);
+        geocache_store(geocache_default(), city, NULL);
         return NULL;
     }
     
-    JsonValue* first = arr->items[0];
-    
     Location* loc = malloc_safe(sizeof(Location));
-    loc->lat.value = json_as_number(json_object_get(first, "latitude"), 0.0);
-    loc->lon.value = json_as_number(json_object_get(first, "longitude"), 0.0);
-    loc->name = strdup_safe(json_as_string(json_object_get(first, "name"), "Unknown"));
-    loc->country = strdup_safe(json_as_string(json_object_get(first, "country"), "Unknown"));
-    
-    json_free(json);
+    loc->lat.value = isnan(lat) ? 0.0 : lat;
+    loc->lon.value = fields[1].count && !isnan(lon) ? lon : 0.0;
+    loc->name = strdup_safe(fields[2].count && name[0] ? name : "Unknown");
+    loc->country = strdup_safe(fields[3].count && country[0] ? country : "Unknown");
+    geocache_store(geocache_default(), city, loc);
     return loc;
 }
 
-Forecast* get_forecast(Location* location) {
+Location* find_location(const char* city) {
+    // Major cities are built in; cities seen before, found or not, are
+    // cached. Neither goes to the network.
+    Location cached;
+    if (gazetteer_lookup(city, &cached)) {
+        Location* loc = malloc_safe(sizeof(Location));
+        *loc = cached;
+        return loc;
+    }
+    switch (geocache_lookup(geocache_default(), city, &cached)) {
+        case GEOCACHE_FOUND: {
+            Location* loc = malloc_safe(sizeof(Location));
+            *loc = cached;
+            return loc;
+        }
+        case GEOCACHE_NOT_FOUND:
+            fprintf(stderr, "Location not found: %s\n", city);
+            return NULL;
+        case GEOCACHE_MISS:
+            break;
+    }
+    
+    char* encoded_city = url_encode(city);
     char url[512];
-    snprintf(url, sizeof(url),
-             "%s?latitude=%.4f&longitude=%.4f&daily=weathercode,temperature_2m_max,temperature_2m_min&timezone=auto",
-             FORECAST_API, location->lat.value, location->lon.value);
+    snprintf(url, sizeof(url), "%s?name=%s&count=1&language=en&format=json",
+             api_url("WEATHER_GEOCODING_URL", GEOCODING_API), encoded_city);
+    free(encoded_city);
+    
+    // Simultaneous lookups of the same city share one request
+    WeatherQuery query = { url, city, NULL };
+    return flight_do(&location_flights, url, fetch_location, &query, copy_location, NULL);
+}
+
+#define NEAR_PLACE_KM 25.0
+
+Location* find_nearest_location(Latitude lat, Longitude lon) {
+    double km;
+    const GazetteerPlace* place = gazetteer_nearest(lat.value, lon.value, &km);
+    
+    // The forecast is for the point itself; the place only names it
+    Location* loc = malloc_safe(sizeof(Location));
+    loc->lat = lat;
+    loc->lon = lon;
+    if (!place) {
+        loc->name = strdup_safe("Unknown");
+        loc->country = strdup_safe("Unknown");
+        return loc;
+    }
     
-    char* response = http_get(url);
+    char name[128];
+    snprintf(name, sizeof(name), km <= NEAR_PLACE_KM ? "%s" : "Near %s", place->name);
+    loc->name = strdup_safe(name);
+    loc->country = strdup_safe(place->country);
+    return loc;
+}
+
+static void* fetch_forecast(void* arg) {
+    const WeatherQuery* query = arg;
+    Location* location = query->location;
+    char* response = http_get(query->url);
     if (!response) {
         fprintf(stderr, "Failed to fetch forecast\n");
         return NULL;
     }
     
-    JsonValue* json = json_parse(response);
+    char dates[FORECAST_MAX_DAYS][DATE_WIDTH];
+    double codes[FORECAST_MAX_DAYS], legacy_codes[FORECAST_MAX_DAYS];
+    double max_temps[FORECAST_MAX_DAYS], min_temps[FORECAST_MAX_DAYS];
+    JsonQueryField fields[5] = {
+        { JSON_QUERY_STRING, dates, FORECAST_MAX_DAYS, DATE_WIDTH, 0 },
+        { JSON_QUERY_NUMBER, codes, FORECAST_MAX_DAYS, 0, 0 },
+        { JSON_QUERY_NUMBER, legacy_codes, FORECAST_MAX_DAYS, 0, 0 },
+        { JSON_QUERY_NUMBER, max_temps, FORECAST_MAX_DAYS, 0, 0 },
+        { JSON_QUERY_NUMBER, min_temps, FORECAST_MAX_DAYS, 0, 0 },
+    };
+    
+    pthread_once(&queries_once, compile_queries);
+    int rc = json_query_run(forecast_query, response, strlen(response), fields);
     free(response);
     
-    if (!json) {
+    if (rc < 0) {
         fprintf(stderr, "Failed to parse forecast JSON\n");
         return NULL;
     }
     
-    JsonValue* daily_obj = json_object_get(json, "daily");
-    if (!daily_obj) {
-        fprintf(stderr, "No 'daily' field in forecast response. Available keys:\n");
-        if (json->type == JSON_OBJECT) {
-            for (size_t i = 0; i < json->data.object_val->count; i++) {
-                fprintf(stderr, "  - %s\n", json->data.object_val->keys[i]);
-            }
-        }
-        json_free(json);
-        return NULL;
-    }
-    
-    JsonArray* times = json_as_array(json_object_get(daily_obj, "time"));
-    JsonArray* codes = json_as_array(json_object_get(daily_obj, "weather_code"));
-    if (!codes) {
-        codes = json_as_array(json_object_get(daily_obj, "weathercode"));
-    }
-    JsonArray* max_temps = json_as_array(json_object_get(daily_obj, "temperature_2m_max"));
-    JsonArray* min_temps = json_as_array(json_object_get(daily_obj, "temperature_2m_min"));
-    
-    if (!times || !codes || !max_temps || !min_temps) {
+    // Older API versions call it weathercode
+    JsonQueryField* code_field = fields[1].count ? &fields[1] : &fields[2];
+    double* code_values = fields[1].count ? codes : legacy_codes;
+    if (fields[0].count == 0 || code_field->count == 0 ||
+        fields[3].count == 0 || fields[4].count == 0) {
         fprintf(stderr, "Missing forecast arrays\n");
-        json_free(json);
         return NULL;
     }
     
@@ -119,20 +237,172 @@ Forecast* get_forecast(Location* location) {
     fc->location = *location;
     fc->location.name = strdup_safe(location->name);
     fc->location.country = strdup_safe(location->country);
-    fc->daily_count = times->count;
+    fc->daily_count = fields[0].count;
     fc->daily = malloc_safe(fc->daily_count * sizeof(DailyForecast));
     
     for (size_t i = 0; i < fc->daily_count; i++) {
-        fc->daily[i].date = strdup_safe(json_as_string(times->items[i], "N/A"));
-        fc->daily[i].weather_code = (int)json_as_number(codes->items[i], -1);
-        fc->daily[i].max_temp.value = json_as_number(max_temps->items[i], 0.0);
-        fc->daily[i].min_temp.value = json_as_number(min_temps->items[i], 0.0);
+        double code = i < code_field->count ? code_values[i] : NAN;
+        double max = i < fields[3].count ? max_temps[i] : NAN;
+        double min = i < fields[4].count ? min_temps[i] : NAN;
+        fc->daily[i].date = strdup_safe(dates[i][0] ? dates[i] : "N/A");
+        fc->daily[i].weather_code = isnan(code) ? -1 : (int)code;
+        fc->daily[i].max_temp.value = isnan(max) ? 0.0 : max;
+        fc->daily[i].min_temp.value = isnan(min) ? 0.0 : min;
     }
     
-    json_free(json);
     return fc;
 }
 
+#define SHM_POLL_INTERVAL 50000   // microseconds
+
+static ForecastCache* forecast_cache;
+static ShmCache* shared_cache;
+static GridSpec grid;
+static time_t model_cadence;
+static pthread_mutex_t forecast_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void create_forecast_cache(void) {
+    // Models other than the default may update more or less often
+    const char* cadence = getenv("WEATHER_MODEL_CADENCE");
+    model_cadence = cadence ? (time_t)strtol(cadence, NULL, 10) : 0;
+    if (model_cadence <= 0) model_cadence = FORECAST_MODEL_CADENCE;
+    forecast_cache = forecast_cache_new(FORECAST_CACHE_BUDGET, model_cadence);
+    
+    // Opt-in: processes started with the same segment name share results
+    const char* name = getenv("WEATHER_SHM_CACHE");
+    if (name && *name) {
+        char segment[256];
+        snprintf(segment, sizeof(segment), "%s%s", name[0] == '/' ? "" : "/", name);
+        shared_cache = shm_cache_open(segment);
+    }
+    
+    // Opt-in: points in one model cell share a request and a cache entry
+    const char* spec = getenv("WEATHER_GRID");
+    if (spec && grid_parse(spec, &grid) < 0) {
+        fprintf(stderr, "Ignoring WEATHER_GRID=%s: expected degrees or geohash:N\n", spec);
+    }
+}
+
+static void ensure_forecast_cache(void) {
+    pthread_mutex_lock(&forecast_cache_lock);
+    if (!forecast_cache) create_forecast_cache();
+    pthread_mutex_unlock(&forecast_cache_lock);
+}
+
+time_t forecast_cadence(void) {
+    ensure_forecast_cache();
+    return model_cadence;
+}
+
+void weather_cleanup(void) {
+    pthread_mutex_lock(&forecast_cache_lock);
+    forecast_cache_free(forecast_cache);
+    forecast_cache = NULL;
+    shm_cache_close(shared_cache);
+    shared_cache = NULL;
+    grid_parse("none", &grid);
+    pthread_mutex_unlock(&forecast_cache_lock);
+}
+
+// Wait for another process's fetch of key to be published; NULL if its
+// claim runs out first, setting *claimed if the claim then passed to us
+static Forecast* await_shared(const char* key, time_t as_of, int* claimed) {
+    time_t deadline = time(NULL) + SHM_CACHE_LEASE;
+    while (time(NULL) <= deadline) {
+        usleep(SHM_POLL_INTERVAL);
+        Forecast* fc = shm_cache_get(shared_cache, key, as_of);
+        if (fc) return fc;
+        if (shm_cache_claim(shared_cache, key, time(NULL))) {
+            *claimed = 1;
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+// A forecast that is still current at as_of, from the shared cache or the
+// network
+static Forecast* fetch_shared(Location* location, const char* key, time_t as_of) {
+    Forecast* fc = shm_cache_get(shared_cache, key, as_of);
+    int claimed = 0;
+    if (!fc && shared_cache) {
+        claimed = shm_cache_claim(shared_cache, key, time(NULL));
+        if (!claimed) fc = await_shared(key, as_of, &claimed);
+    }
+    if (fc) return fc;
+    
+    char url[512];
+    snprintf(url, sizeof(url), "%s?latitude=%.4f&longitude=%.4f&daily=" FORECAST_DAILY "&timezone=auto",
+             api_url("WEATHER_FORECAST_URL", FORECAST_API), location->lat.value, location->lon.value);
+    
+    WeatherQuery query = { url, NULL, location };
+    fc = flight_do(&forecast_flights, url, fetch_forecast, &query, copy_forecast, NULL);
+    if (fc) {
+        shm_cache_put(shared_cache, key, fc, forecast_cache_expiry(as_of, model_cadence));
+    } else if (claimed) {
+        shm_cache_release(shared_cache, key);
+    }
+    return fc;
+}
+
+// Without a grid, only requests for the same coordinates share a
+// forecast; with one, the whole cell does and its centre is requested
+static void forecast_key(const Location* location, char key[128], Location* snapped) {
+    char cell[GRID_KEY_MAX];
+    *snapped = *location;
+    grid_snap(&grid, location->lat.value, location->lon.value, cell,
+              &snapped->lat.value, &snapped->lon.value);
+    snprintf(key, 128, "%s|" FORECAST_DAILY, cell);
+}
+
+Forecast* get_forecast(Location* location) {
+    ensure_forecast_cache();
+    char key[128];
+    Location snapped;
+    forecast_key(location, key, &snapped);
+    
+    // Watched places are answered from memory even when stale; the
+    // scheduler brings them up to date in the background
+    Forecast* fc;
+    if (refresh_watching(location)) {
+        int stale;
+        fc = forecast_cache_get_stale(forecast_cache, key, time(NULL), &stale);
+        if (fc && stale) refresh_revalidate(location);
+    } else {
+        fc = forecast_cache_get(forecast_cache, key, time(NULL));
+    }
+    
+    if (!fc) {
+        fc = fetch_shared(&snapped, key, time(NULL));
+        if (!fc) return NULL;
+        forecast_cache_put(forecast_cache, key, fc, time(NULL));
+    }
+    
+    // The entry may have been fetched for a neighbouring place
+    free(fc->location.name);
+    free(fc->location.country);
+    fc->location = *location;
+    fc->location.name = strdup_safe(location->name);
+    fc->location.country = strdup_safe(location->country);
+    return fc;
+}
+
+int forecast_refresh(Location* location) {
+    ensure_forecast_cache();
+    char key[128];
+    Location snapped;
+    forecast_key(location, key, &snapped);
+    
+    // Refreshes run up to a lead ahead of the model update, and what they
+    // fetch stands in for the period after it
+    time_t as_of = time(NULL) + refresh_lead(model_cadence);
+    Forecast* fc = fetch_shared(&snapped, key, as_of);
+    if (!fc) return -1;
+    forecast_cache_put(forecast_cache, key, fc, as_of);
+    forecast_free(fc);
+    return 0;
+}
+
 const char* get_weather_description(int code) {
     switch (code) {
         case 0: return "Clear sky";
@@ -174,6 +444,19 @@ void location_free(Location* loc) {
     free(loc);
 }
 
+Forecast* forecast_copy(const Forecast* src) {
+    Forecast* fc = malloc_safe(sizeof(Forecast));
+    *fc = *src;
+    fc->location.name = strdup_safe(src->location.name);
+    fc->location.country = strdup_safe(src->location.country);
+    fc->daily = malloc_safe(src->daily_count * sizeof(DailyForecast));
+    for (size_t i = 0; i < src->daily_count; i++) {
+        fc->daily[i] = src->daily[i];
+        fc->daily[i].date = strdup_safe(src->daily[i].date);
+    }
+    return fc;
+}
+
 void forecast_free(Forecast* fc) {
     if (!fc) return;
     free(fc->location.name);
@@ -2,11 +2,35 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
+#include <math.h>
+#include <locale.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
 #include "../include/json.h"
+#include "../include/json_index.h"
+#include "../include/json_number.h"
 #include "../include/core.h"
 #include "../include/weather.h"
 #include "../include/ui.h"
 #include "../include/tui.h"
+#include "../include/http.h"
+#include "../include/dns.h"
+#include "../include/inflate.h"
+#include "../include/singleflight.h"
+#include "../include/geocache.h"
+#include "../include/forecast_cache.h"
+#include "../include/shm_cache.h"
+#include "../include/gazetteer.h"
+#include "../include/grid.h"
+#include "../include/refresh.h"
 
 // Test counters
 static int tests_run = 0;
@@ -21,6 +45,282 @@ static int tests_passed = 0;
     printf("  ✓ PASSED\n"); \
 } while(0)
 
+// Local HTTP server for HTTP client tests.
+// Runs in a forked process group; each accepted connection is served by
+// its own child so concurrent clients don't queue behind each other.
+typedef void (*ConnHandler)(int fd, int conn_index);
+
+typedef struct {
+    pid_t pid;
+    int port;
+} TestServer;
+
+static TestServer start_test_server(ConnHandler handler) {
+    TestServer srv;
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(lfd >= 0);
+    int one = 1;
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    assert(bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    assert(listen(lfd, 16) == 0);
+    
+    socklen_t len = sizeof(addr);
+    getsockname(lfd, (struct sockaddr*)&addr, &len);
+    srv.port = ntohs(addr.sin_port);
+    
+    srv.pid = fork();
+    assert(srv.pid >= 0);
+    if (srv.pid == 0) {
+        setpgid(0, 0);
+        signal(SIGCHLD, SIG_IGN);
+        alarm(30); // never outlive a crashed test run
+        for (int conn = 1; ; conn++) {
+            int fd = accept(lfd, NULL, NULL);
+            if (fd < 0) _exit(0);
+            if (fork() == 0) {
+                alarm(30);
+                // Small writes go out as written, so dribbling handlers really dribble
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                handler(fd, conn);
+                _exit(0);
+            }
+            close(fd);
+        }
+    }
+    setpgid(srv.pid, srv.pid);
+    close(lfd);
+    return srv;
+}
+
+static void stop_test_server(TestServer* srv) {
+    kill(-srv->pid, SIGTERM);
+    waitpid(srv->pid, NULL, 0);
+    http_cleanup();
+}
+
+// Read one request head; returns 0 when the client closed the connection
+static int read_request(int fd) {
+    char buf[4096];
+    size_t len = 0;
+    while (len < sizeof(buf) - 1) {
+        ssize_t n = read(fd, buf + len, 1);
+        if (n <= 0) return 0;
+        len += n;
+        if (len >= 4 && memcmp(buf + len - 4, "\r\n\r\n", 4) == 0) return 1;
+    }
+    return 0;
+}
+
+static void send_str(int fd, const char* s) {
+    ssize_t unused = write(fd, s, strlen(s));
+    (void)unused;
+}
+
+static void reply_conn_index(int fd, int conn_index) {
+    char body[32], resp[128];
+    snprintf(body, sizeof(body), "{\"conn\": %d}", conn_index);
+    snprintf(resp, sizeof(resp), "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n\r\n%s",
+             strlen(body), body);
+    send_str(fd, resp);
+}
+
+static void handler_keep_alive(int fd, int conn_index) {
+    while (read_request(fd)) reply_conn_index(fd, conn_index);
+}
+
+// Answers one request, then drops the socket without announcing it
+static void handler_close_after_one(int fd, int conn_index) {
+    if (read_request(fd)) reply_conn_index(fd, conn_index);
+}
+
+// Holds every response back so batch tests can tell parallel from serial
+static void handler_slow(int fd, int conn_index) {
+    while (read_request(fd)) {
+        usleep(200000);
+        reply_conn_index(fd, conn_index);
+    }
+}
+
+// The first connection swallows its request and never answers
+static void handler_stall_first(int fd, int conn_index) {
+    if (conn_index == 1) {
+        if (read_request(fd)) sleep(10);
+        return;
+    }
+    while (read_request(fd)) reply_conn_index(fd, conn_index);
+}
+
+// 200 KB body: first request framed by Content-Length, later ones chunked
+#define LARGE_BODY_SIZE 200000
+
+static void send_all_test(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n <= 0) return;
+        data += n;
+        len -= n;
+    }
+}
+
+static void handler_large_body(int fd, int conn_index) {
+    (void)conn_index;
+    char* body = malloc(LARGE_BODY_SIZE);
+    for (size_t i = 0; i < LARGE_BODY_SIZE; i++) body[i] = 'a' + i % 26;
+    
+    for (int req = 0; read_request(fd); req++) {
+        char head[128];
+        if (req == 0) {
+            snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n",
+                     LARGE_BODY_SIZE);
+            send_str(fd, head);
+            send_all_test(fd, body, LARGE_BODY_SIZE);
+            continue;
+        }
+        send_str(fd, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n");
+        for (size_t off = 0; off < LARGE_BODY_SIZE; off += 7000) {
+            size_t n = LARGE_BODY_SIZE - off < 7000 ? LARGE_BODY_SIZE - off : 7000;
+            snprintf(head, sizeof(head), "%zx\r\n", n);
+            send_str(fd, head);
+            send_all_test(fd, body + off, n);
+            send_str(fd, "\r\n");
+        }
+        send_str(fd, "0\r\n\r\n");
+    }
+    free(body);
+}
+
+// Chunk extensions, a trailer and a NUL byte, dribbled out a few bytes at a time
+static void handler_chunked_tricky(int fd, int conn_index) {
+    (void)conn_index;
+    static const char resp[] =
+        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "5;name=value\r\nab\0cd\r\n"
+        "A\r\n0123456789\r\n"
+        "0\r\nX-Checksum: 42\r\n\r\n";
+    while (read_request(fd)) {
+        for (size_t off = 0; off < sizeof(resp) - 1; off += 3) {
+            size_t n = sizeof(resp) - 1 - off < 3 ? sizeof(resp) - 1 - off : 3;
+            send_all_test(fd, resp + off, n);
+            usleep(1000);
+        }
+    }
+}
+
+// Collects whatever requests are queued up and answers them all in one
+// write, alternating Content-Length and chunked framing; hangs up after 5
+static void handler_pipelined(int fd, int conn_index) {
+    char in[8192], out[8192];
+    size_t in_len = 0;
+    int answered = 0;
+    
+    while (answered < 5) {
+        ssize_t n = read(fd, in + in_len, sizeof(in) - 1 - in_len);
+        if (n <= 0) return;
+        in_len += n;
+        in[in_len] = '\0';
+        
+        size_t out_len = 0;
+        char* end;
+        while (answered < 5 && (end = strstr(in, "\r\n\r\n")) != NULL) {
+            char path[64] = "";
+            sscanf(in, "GET %63s", path);
+            char body[128];
+            snprintf(body, sizeof(body), "{\"conn\": %d, \"path\": \"%s\"}", conn_index, path);
+            if (answered % 2 == 0) {
+                out_len += snprintf(out + out_len, sizeof(out) - out_len,
+                                    "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n\r\n%s",
+                                    strlen(body), body);
+            } else {
+                out_len += snprintf(out + out_len, sizeof(out) - out_len,
+                                    "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                                    "%zx\r\n%s\r\n0\r\n\r\n", strlen(body), body);
+            }
+            answered++;
+            size_t used = end + 4 - in;
+            memmove(in, end + 4, in_len - used + 1);
+            in_len -= used;
+        }
+        send_all_test(fd, out, out_len);
+    }
+}
+
+// Daily forecast JSON, gzip level 9 (dynamic Huffman block)
+static const char forecast_json[] =
+    "{\"daily\":{\"time\":[\"2024-06-01\",\"2024-06-02\",\"2024-06-03\",\"2024-06-04\","
+    "\"2024-06-05\",\"2024-06-06\",\"2024-06-07\"],\"weathercode\":[3,61,61,2,0,1,3],"
+    "\"temperature_2m_max\":[21.4,18.9,17.2,22.8,25.1,24.6,20.3],"
+    "\"temperature_2m_min\":[12.1,11.8,10.9,13.4,14.7,15.2,13.0]}}";
+
+static const unsigned char forecast_gz[] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x6d, 0x8d,
+    0xd1, 0x0a, 0xc2, 0x30, 0x0c, 0x45, 0xff, 0x25, 0xcf, 0x59, 0x68, 0xd2,
+    0xae, 0x9b, 0xfb, 0x15, 0x19, 0xa3, 0xb8, 0x82, 0x03, 0xab, 0x32, 0x3a,
+    0x54, 0xc6, 0xfe, 0xdd, 0xf4, 0xc9, 0x3e, 0x08, 0x79, 0x39, 0xdc, 0x7b,
+    0x6e, 0x76, 0x98, 0xc3, 0x72, 0xfb, 0xc0, 0xb0, 0x43, 0x5e, 0x52, 0x84,
+    0xe1, 0x0c, 0x62, 0xc4, 0x35, 0xc6, 0x37, 0x86, 0x01, 0x7f, 0x20, 0x35,
+    0xd8, 0x1a, 0x5c, 0x0d, 0x6d, 0x0d, 0xbe, 0x86, 0x0e, 0x46, 0x84, 0x57,
+    0x0c, 0xf9, 0x1a, 0xd7, 0xcb, 0x63, 0x2e, 0xaf, 0x2c, 0x7a, 0x2e, 0x27,
+    0x68, 0x90, 0xd1, 0x6a, 0x9e, 0x63, 0x7a, 0xc6, 0x35, 0xe4, 0x6d, 0x8d,
+    0x93, 0xa4, 0x29, 0x85, 0xb7, 0xd6, 0x84, 0xc9, 0x21, 0xf7, 0x74, 0x42,
+    0xee, 0x48, 0x50, 0x84, 0x7a, 0x94, 0x96, 0xd4, 0x73, 0xe4, 0x51, 0x0c,
+    0xfd, 0x33, 0x97, 0xbb, 0x9a, 0x2c, 0xda, 0x62, 0xd6, 0x3e, 0x9b, 0xa2,
+    0xdb, 0x32, 0xe4, 0xa8, 0x43, 0x6e, 0x75, 0x48, 0xd1, 0x8c, 0xc7, 0xf1,
+    0x05, 0x8e, 0xbf, 0xc3, 0xde, 0x03, 0x01, 0x00, 0x00
+};
+
+// "stored block aaaa...", zlib level 0
+static const unsigned char stored_zlib[] = {
+    0x78, 0x01, 0x01, 0x21, 0x00, 0xde, 0xff, 0x73, 0x74, 0x6f, 0x72, 0x65,
+    0x64, 0x20, 0x62, 0x6c, 0x6f, 0x63, 0x6b, 0x20, 0x61, 0x61, 0x61, 0x61,
+    0x61, 0x61, 0x61, 0x61, 0x61, 0x61, 0x61, 0x61, 0x61, 0x61, 0x61, 0x61,
+    0x61, 0x61, 0x61, 0x61, 0xd5, 0x33, 0x0c, 0x71
+};
+
+// Serves forecast_gz: Content-Length framed first, chunked afterwards
+static void handler_gzip(int fd, int conn_index) {
+    (void)conn_index;
+    for (int req = 0; read_request(fd); req++) {
+        char head[160];
+        if (req == 0) {
+            snprintf(head, sizeof(head),
+                     "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\nContent-Length: %zu\r\n\r\n",
+                     sizeof(forecast_gz));
+            send_str(fd, head);
+            send_all_test(fd, (const char*)forecast_gz, sizeof(forecast_gz));
+            continue;
+        }
+        send_str(fd, "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\n"
+                     "Transfer-Encoding: chunked\r\n\r\n");
+        for (size_t off = 0; off < sizeof(forecast_gz); off += 40) {
+            size_t n = sizeof(forecast_gz) - off < 40 ? sizeof(forecast_gz) - off : 40;
+            snprintf(head, sizeof(head), "%zx\r\n", n);
+            send_str(fd, head);
+            send_all_test(fd, (const char*)forecast_gz + off, n);
+            send_str(fd, "\r\n");
+            usleep(1000);
+        }
+        send_str(fd, "0\r\n\r\n");
+    }
+}
+
+static int fetch_conn_index(int port) {
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/", port);
+    char* body = http_get(url);
+    assert(body != NULL);
+    JsonValue* json = json_parse(body);
+    int conn = (int)json_as_number(json_object_get(json, "conn"), -1);
+    json_free(json);
+    free(body);
+    return conn;
+}
+
 // JSON Parser Tests
 TEST(json_parse_null) {
     JsonValue* val = json_parse("null");
@@ -65,9 +365,9 @@ TEST(json_parse_array) {
     assert(val->type == JSON_ARRAY);
     JsonArray* arr = val->data.array_val;
     assert(arr->count == 3);
-    assert(arr->items[0]->data.number_val == 1.0);
-    assert(arr->items[1]->data.number_val == 2.0);
-    assert(arr->items[2]->data.number_val == 3.0);
+    assert(arr->numbers[0] == 1.0);
+    assert(arr->numbers[1] == 2.0);
+    assert(arr->numbers[2] == 3.0);
     json_free(val);
 }
 
@@ -104,6 +404,500 @@ TEST(json_parse_nested) {
     json_free(val);
 }
 
+// 20000-element array of objects, wide enough to need several arena blocks
+static char* make_wide_array(size_t count) {
+    char* json = malloc(count * 32 + 3);
+    size_t len = 0;
+    json[len++] = '[';
+    for (size_t i = 0; i < count; i++) {
+        len += sprintf(json + len, "%s{\"i\": %zu, \"s\": \"x\"}", i ? "," : "", i);
+    }
+    json[len++] = ']';
+    json[len] = '\0';
+    return json;
+}
+
+TEST(json_parse_large_array) {
+    char* json = make_wide_array(20000);
+    JsonValue* val = json_parse(json);
+    JsonArray* arr = json_as_array(val);
+    assert(arr != NULL && arr->count == 20000);
+    assert(json_as_number(json_object_get(arr->items[19999], "i"), -1) == 19999);
+    json_free(val);
+    
+    assert(json_parse("[1, [2, {\"a\": 3,") == NULL);
+    free(json);
+}
+
+TEST(json_arena_reuse) {
+    char* json = make_wide_array(20000);
+    JsonArena* arena = json_arena_new(0);
+    
+    JsonValue* val = json_parse_arena(json, arena);
+    JsonArray* arr = json_as_array(val);
+    assert(arr != NULL && arr->count == 20000);
+    assert(strcmp(json_as_string(json_object_get(arr->items[123], "s"), ""), "x") == 0);
+    size_t capacity = json_arena_capacity(arena);
+    
+    // Once warmed up, the arena serves later documents without growing
+    for (int round = 0; round < 3; round++) {
+        json_arena_reset(arena);
+        val = json_parse_arena(json, arena);
+        assert(json_as_array(val)->count == 20000);
+        assert(json_parse_arena("{\"broken\": [1, 2", arena) == NULL);
+        assert(json_arena_capacity(arena) == capacity);
+    }
+    
+    json_arena_free(arena);
+    free(json);
+}
+
+TEST(json_object_hashed_lookup) {
+    size_t cap = 16 * 1024, used = 0;
+    char* json = malloc(cap);
+    used += snprintf(json + used, cap - used, "{");
+    for (int i = 0; i < 300; i++) {
+        used += snprintf(json + used, cap - used, "\"temperature_%d\": %d, ", i, i);
+    }
+    snprintf(json + used, cap - used, "\"temperature_7\": -1, \"small\": {\"a\": 1, \"b\": 2, \"a\": 3}}");
+    
+    JsonArena* arena = json_arena_new(0);
+    JsonValue* trees[2] = { json_parse(json), json_parse_arena(json, arena) };
+    for (int t = 0; t < 2; t++) {
+        JsonValue* val = trees[t];
+        assert(val->data.object_val->slots != NULL);
+        
+        char key[32];
+        for (int i = 0; i < 300; i++) {
+            snprintf(key, sizeof(key), "temperature_%d", i);
+            JsonKey prepared = json_key(key);
+            // A duplicate key resolves to its first occurrence
+            assert(json_as_number(json_object_get_key(val, &prepared), -2) == i);
+            assert(json_as_number(json_object_get(val, key), -2) == i);
+        }
+        assert(json_object_get(val, "temperature_300") == NULL);
+        assert(json_object_get(val, "") == NULL);
+        
+        JsonValue* small = json_object_get(val, "small");
+        assert(small->data.object_val->slots == NULL);
+        assert(json_as_number(json_object_get(small, "a"), -1) == 1);
+        assert(json_as_number(json_object_get(small, "b"), -1) == 2);
+        assert(json_object_get(small, "c") == NULL);
+    }
+    
+    json_free(trees[0]);
+    json_arena_free(arena);
+    free(json);
+}
+
+TEST(json_numeric_arrays_packed) {
+    const char* json = "{\"hourly\": [12.5, null, -3, 1e2], \"nested\": [[1, 2], [null, 4]],"
+                       " \"mixed\": [1, \"two\", null, 3], \"nulls\": [null, null], \"empty\": [],"
+                       " \"bad\": [1, 2, 3]}";
+    JsonArena* arena = json_arena_new(0);
+    JsonValue* trees[2] = { json_parse(json), json_parse_arena(json, arena) };
+    
+    for (int t = 0; t < 2; t++) {
+        JsonValue* val = trees[t];
+        size_t count;
+        const unsigned char* nulls;
+        const double* hourly = json_as_double_array(json_object_get(val, "hourly"), &count, &nulls);
+        assert(hourly && count == 4 && nulls);
+        assert(hourly[0] == 12.5 && isnan(hourly[1]) && hourly[2] == -3 && hourly[3] == 100);
+        assert(nulls[0] == 0x02);
+        
+        JsonArray* nested = json_as_array(json_object_get(val, "nested"));
+        assert(nested->items && nested->count == 2);
+        const double* row = json_as_double_array(nested->items[1], &count, &nulls);
+        assert(row && count == 2 && nulls[0] == 0x01 && row[1] == 4);
+        assert(json_as_double_array(nested->items[0], &count, &nulls) && nulls == NULL);
+        
+        // Anything else keeps one value per element
+        JsonArray* mixed = json_as_array(json_object_get(val, "mixed"));
+        assert(mixed->items && !mixed->numbers && mixed->count == 4);
+        assert(json_as_number(mixed->items[0], 0) == 1 && mixed->items[2]->type == JSON_NULL);
+        assert(json_as_number(mixed->items[3], 0) == 3);
+        assert(json_as_double_array(json_object_get(val, "nulls"), &count, NULL) == NULL);
+        assert(json_as_double_array(json_object_get(val, "empty"), &count, NULL) == NULL);
+        assert(json_as_double_array(json_object_get(val, "mixed"), &count, NULL) == NULL);
+    }
+    
+    assert(json_parse("[1, 2, nul]") == NULL);
+    assert(json_parse("[1, 2, [3, 4]") == NULL);
+    assert(json_parse("[[1, 2], \"x\", [3,]]") == NULL);
+    
+    json_free(trees[0]);
+    json_arena_free(arena);
+}
+
+TEST(json_strings_insitu_and_escapes) {
+    const char* json = "{\"date\": \"2024-01-01\", \"caf\\u00e9\": \"Caf\\u00e9 \\ud83d\\ude00\\/\\b\","
+                       " \"lone\": \"\\ud83d-\\ude00\", \"nul\": \"a\\u0000b\", \"empty\": \"\"}";
+    char* buffer = strdup(json);
+    JsonArena* arena = json_arena_new(0);
+    JsonValue* trees[2] = { json_parse(json), json_parse_insitu(buffer, arena) };
+    
+    for (int t = 0; t < 2; t++) {
+        JsonValue* val = trees[t];
+        JsonValue* date = json_object_get(val, "date");
+        assert(date->data.string_len == 10 && strcmp(date->data.string_val, "2024-01-01") == 0);
+        JsonValue* cafe = json_object_get(val, "caf\xc3\xa9");
+        assert(cafe && strcmp(cafe->data.string_val, "Caf\xc3\xa9 \xf0\x9f\x98\x80/\b") == 0);
+        assert(strcmp(json_as_string(json_object_get(val, "lone"), ""),
+                      "\xef\xbf\xbd-\xef\xbf\xbd") == 0);
+        JsonValue* nul = json_object_get(val, "nul");
+        assert(nul->data.string_len == 3 && memcmp(nul->data.string_val, "a\0b", 3) == 0);
+        assert(json_object_get(val, "empty")->data.string_len == 0);
+    }
+    
+    // In situ, strings and keys are slices of the buffer itself
+    const char* date = json_as_string(json_object_get(trees[1], "date"), "");
+    assert(date > buffer && date < buffer + strlen(json));
+    assert(trees[1]->data.object_val->keys[0] == buffer + 2);
+    
+    const char* bad[] = { "\"\\x\"", "\"\\u12\"", "\"\\u12g4\"", "[\"ok\", \"\\q\"]" };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        assert(json_parse(bad[i]) == NULL);
+        char copy[32];
+        snprintf(copy, sizeof(copy), "%s", bad[i]);
+        assert(json_parse_insitu(copy, arena) == NULL);
+    }
+    assert(json_parse_insitu(buffer, NULL) == NULL);
+    
+    json_free(trees[0]);
+    json_arena_free(arena);
+    free(buffer);
+}
+
+TEST(json_index_kernels_agree) {
+    const char* small = " {\"a\\\"[\": [1, true]} ";
+    const uint32_t want[] = { 1, 2, 7, 8, 10, 11, 12, 14, 18, 19, 21 };
+    uint32_t* pos;
+    assert(json_index_build(small, strlen(small), &pos) == 11);
+    assert(memcmp(pos, want, sizeof(want)) == 0);
+    free(pos);
+    
+    // Escape runs and quotes landing on every offset of a 64-byte block
+    size_t cap = 64 * 1024, used = 0;
+    char* json = malloc(cap);
+    used += snprintf(json + used, cap - used, "[");
+    for (int i = 0; i < 140; i++) {
+        used += snprintf(json + used, cap - used, "%s\"%.*s\\\\\\\" {y}\"", i ? ", " : "", i % 70,
+                         "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx");
+    }
+    snprintf(json + used, cap - used, "]");
+    
+    uint32_t* scalar;
+    assert(json_index_set_kernel(JSON_INDEX_SCALAR) == 0);
+    size_t count = json_index_build(json, strlen(json), &scalar);
+    assert(count == 1 + 140 * 2 + 139 + 1 + 1);
+    
+    JsonIndexKernel kernels[] = { JSON_INDEX_SCALAR, JSON_INDEX_SSE2, JSON_INDEX_AVX2 };
+    for (size_t k = 0; k < 3; k++) {
+        if (json_index_set_kernel(kernels[k]) < 0) continue;
+        assert(json_index_build(json, strlen(json), &pos) == count);
+        assert(memcmp(pos, scalar, count * sizeof(uint32_t)) == 0);
+        free(pos);
+        
+        JsonValue* val = json_parse(json);
+        JsonArray* arr = json_as_array(val);
+        assert(arr && arr->count == 140);
+        for (size_t i = 0; i < arr->count; i++) {
+            const char* str = json_as_string(arr->items[i], "");
+            assert(strlen(str) == i % 70 + 6 && strcmp(str + i % 70, "\\\" {y}") == 0);
+        }
+        json_free(val);
+    }
+    assert(json_index_set_kernel(JSON_INDEX_AUTO) == 0);
+    
+    assert(json_parse("[1x]") == NULL);
+    assert(json_parse("[true false]") == NULL);
+    assert(json_parse("{\"a\": \"unterminated}") == NULL);
+    free(scalar);
+    free(json);
+}
+
+TEST(json_number_rounding_and_grammar) {
+    const char* cases[] = { "0", "-0", "12.5", "-7.25", "0.1", "1e23", "9007199254740993",
+                            "2.2250738585072011e-308", "4.9e-324", "1.7976931348623157e308",
+                            "1e-400", "3.141592653589793238462643383279", "0.000001e6",
+                            "123456789012345678901234567890e-10", "17976931348623159e292" };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        double got, want = strtod(cases[i], NULL);
+        const char* end = json_number_parse(cases[i], &got);
+        assert(end && *end == '\0');
+        assert(memcmp(&got, &want, sizeof(double)) == 0);
+    }
+    
+    const char* bad[] = { "01", "1.", ".5", "+1", "1e", "1e+", "-", "0x10", "inf", "NaN", "1.e5" };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        double d;
+        const char* end = json_number_parse(bad[i], &d);
+        assert(!end || *end != '\0');
+        char doc[32];
+        snprintf(doc, sizeof(doc), "[%s]", bad[i]);
+        assert(json_parse(doc) == NULL);
+    }
+    
+    // A decimal-comma locale must not change the result
+    if (setlocale(LC_NUMERIC, "de_DE.UTF-8")) {
+        JsonValue* val = json_parse("[1.5, 2.25e1]");
+        assert(json_as_array(val)->numbers[0] == 1.5);
+        assert(json_as_array(val)->numbers[1] == 22.5);
+        json_free(val);
+        setlocale(LC_NUMERIC, "C");
+    }
+}
+
+TEST(json_serialize_text_and_binary) {
+    const char* json = "{\"name\": \"Caf\\u00e9 \\\"Q\\\"\\n\", \"ok\": true, \"none\": null,"
+                       " \"temps\": [0.1, null, -3, 1e300, 5e-324], \"mixed\": [1, \"a\", [], {}],"
+                       " \"k0\": 0, \"k1\": 1, \"k2\": 2, \"k3\": 3, \"k4\": 4, \"k5\": 5, \"k6\": 6}";
+    const char* compact = "{\"name\":\"Caf\xc3\xa9 \\\"Q\\\"\\n\",\"ok\":true,\"none\":null,"
+                          "\"temps\":[0.1,null,-3,1e+300,4.94065645841247e-324],"
+                          "\"mixed\":[1,\"a\",[],{}],\"k0\":0,\"k1\":1,\"k2\":2,\"k3\":3,"
+                          "\"k4\":4,\"k5\":5,\"k6\":6}";
+    JsonValue* val = json_parse(json);
+    size_t len;
+    char* text = json_serialize(val, &len);
+    assert(len == strlen(compact) && strcmp(text, compact) == 0);
+    
+    // The text reads back to the same tree
+    JsonValue* again = json_parse(text);
+    char* text2 = json_serialize(again, NULL);
+    assert(strcmp(text2, text) == 0);
+    free(text2);
+    
+    // Whatever the locale's decimal point, numbers are written with '.'
+    if (setlocale(LC_NUMERIC, "de_DE.UTF-8")) {
+        text2 = json_serialize(again, NULL);
+        assert(strcmp(text2, text) == 0);
+        free(text2);
+        setlocale(LC_NUMERIC, "C");
+    }
+    json_free(again);
+    
+    size_t image_len;
+    void* image = json_binary_encode(val, &image_len);
+    json_free(val);
+    
+    // Loaded in place, then again after moving elsewhere
+    void* moved = malloc(image_len);
+    for (int round = 0; round < 2; round++) {
+        JsonValue* loaded = json_binary_load(image, image_len);
+        assert(loaded != NULL);
+        char* out = json_serialize(loaded, NULL);
+        assert(strcmp(out, compact) == 0);
+        free(out);
+        assert(json_as_number(json_object_get(loaded, "k6"), -1) == 6);
+        size_t count;
+        assert(json_as_double_array(json_object_get(loaded, "temps"), &count, NULL)[0] == 0.1);
+        memcpy(moved, image, image_len);
+        memset(image, 0, image_len);
+        void* tmp = image;
+        image = moved;
+        moved = tmp;
+    }
+    
+    char path[] = "/tmp/weather-json-XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0 && write(fd, image, image_len) == (ssize_t)image_len);
+    close(fd);
+    JsonMapping map;
+    JsonValue* mapped = json_binary_map(path, &map);
+    assert(mapped && strcmp(json_as_string(json_object_get(mapped, "name"), ""), "Caf\xc3\xa9 \"Q\"\n") == 0);
+    json_binary_unmap(&map);
+    
+    // Truncated or damaged images are refused untouched
+    assert(json_binary_load(image, image_len - 8) == NULL);
+    ((char*)image)[0] = 'X';
+    assert(json_binary_load(image, image_len) == NULL);
+    fd = open(path, O_WRONLY | O_TRUNC);
+    assert(fd >= 0 && write(fd, image, 16) == 16);
+    close(fd);
+    assert(json_binary_map(path, &map) == NULL);
+    unlink(path);
+    
+    free(image);
+    free(moved);
+    free(text);
+}
+
+// Patch size bytes at off in a copy of image and expect it to be refused
+// without being changed
+static void assert_image_refused(const void* image, size_t len, size_t off, const void* patch, size_t size) {
+    void* copy = malloc(len);
+    memcpy(copy, image, len);
+    memcpy((char*)copy + off, patch, size);
+    void* before = malloc(len);
+    memcpy(before, copy, len);
+    assert(json_binary_load(copy, len) == NULL);
+    assert(memcmp(copy, before, len) == 0);
+    free(before);
+    free(copy);
+}
+
+TEST(json_binary_rejects_corrupt_images) {
+    JsonValue* val = json_parse("{\"temps\": [1, 2, 3], \"name\": \"Oslo\", \"list\": [\"a\", \"b\"],"
+                                " \"k0\": 0, \"k1\": 1, \"k2\": 2, \"k3\": 3, \"k4\": 4, \"k5\": 5}");
+    size_t len;
+    void* image = json_binary_encode(val, &len);
+    json_free(val);
+    
+    // Header fields: relocation table offset at 40, its length at 48
+    uint64_t relocs, reloc_count;
+    memcpy(&relocs, (char*)image + 40, sizeof(relocs));
+    memcpy(&reloc_count, (char*)image + 48, sizeof(reloc_count));
+    assert(reloc_count >= 2 && relocs + reloc_count * 8 == len);
+    
+    // Relocations aimed at the table itself, the header or a repeated slot
+    uint64_t slot = relocs + 8;
+    assert_image_refused(image, len, relocs, &slot, sizeof(slot));
+    slot = 32;
+    assert_image_refused(image, len, relocs, &slot, sizeof(slot));
+    memcpy(&slot, (char*)image + relocs, sizeof(slot));
+    assert_image_refused(image, len, relocs + 8, &slot, sizeof(slot));
+    
+    // Find nodes through a loaded copy, then damage them in the original
+    void* loaded = malloc(len);
+    memcpy(loaded, image, len);
+    JsonValue* root = json_binary_load(loaded, len);
+    assert(root != NULL);
+    size_t huge = (size_t)1 << 40;
+    JsonArray* temps = json_as_array(json_object_get(root, "temps"));
+    // A relocation for a slot that is not a pointer of the tree
+    slot = (uint64_t)((char*)&temps->count - (char*)loaded);
+    assert_image_refused(image, len, relocs, &slot, sizeof(slot));
+    assert_image_refused(image, len, (size_t)((char*)&temps->count - (char*)loaded), &huge, sizeof(huge));
+    JsonArray* list = json_as_array(json_object_get(root, "list"));
+    assert_image_refused(image, len, (size_t)((char*)&list->count - (char*)loaded), &huge, sizeof(huge));
+    // Two values sharing one array node
+    uintptr_t alias = (uintptr_t)((char*)list - (char*)loaded);
+    JsonValue* temps_val = json_object_get(root, "temps");
+    assert_image_refused(image, len, (size_t)((char*)&temps_val->data.array_val - (char*)loaded), &alias, sizeof(alias));
+    JsonValue* name = json_object_get(root, "name");
+    assert_image_refused(image, len, (size_t)((char*)&name->data.string_len - (char*)loaded), &huge, sizeof(huge));
+    JsonObject* obj = root->data.object_val;
+    assert(obj->slots != NULL);
+    assert_image_refused(image, len, (size_t)((char*)&obj->count - (char*)loaded), &huge, sizeof(huge));
+    assert_image_refused(image, len, (size_t)((char*)&obj->slot_mask - (char*)loaded), &huge, sizeof(huge));
+    uint32_t entry = 99;
+    assert_image_refused(image, len, (size_t)((char*)&obj->slots[0] - (char*)loaded), &entry, sizeof(entry));
+    JsonType type = (JsonType)42;
+    assert_image_refused(image, len, (size_t)((char*)&name->type - (char*)loaded), &type, sizeof(type));
+    // A string losing its terminator
+    assert_image_refused(image, len, (size_t)(name->data.string_val + 4 - (char*)loaded), "!", 1);
+    
+    // The untouched original still loads
+    assert(json_binary_load(image, len) != NULL);
+    free(loaded);
+    free(image);
+}
+
+
+// Run a reader over json split into pieces of chunk bytes and describe
+// every token in out; returns the final token type
+static JsonTokenType reader_transcript(const char* json, size_t chunk, char* out, size_t size) {
+    JsonReader* reader = json_reader_new();
+    size_t len = strlen(json), pos = 0, used = 0;
+    JsonToken tok;
+    JsonTokenType type;
+    out[0] = '\0';
+    
+    while ((type = json_reader_next(reader, &tok)) != JSON_TOKEN_END && type != JSON_TOKEN_ERROR) {
+        if (type == JSON_TOKEN_NEED_MORE) {
+            size_t n = len - pos < chunk ? len - pos : chunk;
+            json_reader_feed(reader, json + pos, n);
+            pos += n;
+            if (pos == len) json_reader_finish(reader);
+            continue;
+        }
+        if (type == JSON_TOKEN_KEY || type == JSON_TOKEN_STRING) {
+            used += snprintf(out + used, size - used, "%c%d:%s ",
+                             type == JSON_TOKEN_KEY ? 'K' : 'S', tok.depth, tok.string);
+        } else if (type == JSON_TOKEN_NUMBER) {
+            used += snprintf(out + used, size - used, "N%d:%g ", tok.depth, tok.number);
+        } else if (type == JSON_TOKEN_BOOL) {
+            used += snprintf(out + used, size - used, "B%d:%d ", tok.depth, tok.bool_val);
+        } else if (type == JSON_TOKEN_NULL) {
+            used += snprintf(out + used, size - used, "Z%d ", tok.depth);
+        } else {
+            used += snprintf(out + used, size - used, "%c%d ", "{}[]"[type], tok.depth);
+        }
+    }
+    json_reader_free(reader);
+    return type;
+}
+
+TEST(json_reader_resumes_across_chunks) {
+    const char* json = " {\"name\": \"Caf\\u00e9 \\ud83d\\ude00\\n\", \"list\": [-1.5e3, 0, true, null,"
+                       " {}, []], \"esc\": \"a\\\"b\", \"f\": false} ";
+    char whole[512], piece[512];
+    assert(reader_transcript(json, strlen(json), whole, sizeof(whole)) == JSON_TOKEN_END);
+    assert(strcmp(whole, "{0 K1:name S1:Caf\xc3\xa9 \xf0\x9f\x98\x80\n K1:list [1 N2:-1500 N2:0 "
+                         "B2:1 Z2 {2 }2 [2 ]2 ]1 K1:esc S1:a\"b K1:f B1:0 }0 ") == 0);
+    
+    // Every split point, down to one byte at a time, gives the same tokens
+    for (size_t chunk = 1; chunk < 8; chunk++) {
+        assert(reader_transcript(json, chunk, piece, sizeof(piece)) == JSON_TOKEN_END);
+        assert(strcmp(piece, whole) == 0);
+    }
+    
+    const char* bad[] = { "[1,]", "{\"a\" 1}", "[1", "01", "[1] x", "\"tab\there\"", "tru" };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        assert(reader_transcript(bad[i], 1, piece, sizeof(piece)) == JSON_TOKEN_ERROR);
+    }
+}
+
+TEST(json_query_extracts_paths) {
+    const char* json = "{\"meta\": {\"daily\": {\"time\": [\"wrong\"]}, \"list\": [[1, {\"x\": 2}]]},"
+                       " \"results\": [{\"name\": \"Lisboa\", \"latitude\": 38.7}, {\"name\": \"Other\"}],"
+                       " \"daily\": {\"time\": [\"2024-01-01\", \"2024-01-02\", \"2024-01-03\"],"
+                       " \"temperature_2m_max\": [12.5, null, 14], \"note\": \"a long string here\"}}";
+    const char* paths[] = { "results[0].name", "results[0].latitude", "daily.time[*]",
+                            "daily.temperature_2m_max[*]", "daily.note", "daily.missing[*]" };
+    JsonQuery* query = json_query_compile(paths, 6);
+    assert(query != NULL);
+    
+    char name[16], times[2][16], note[7];
+    double lat, temps[4], missing[4];
+    JsonQueryField fields[6] = {
+        { JSON_QUERY_STRING, name, 1, sizeof(name), 0 },
+        { JSON_QUERY_NUMBER, &lat, 1, 0, 0 },
+        { JSON_QUERY_STRING, times, 2, 16, 0 },
+        { JSON_QUERY_NUMBER, temps, 4, 0, 0 },
+        { JSON_QUERY_STRING, note, 1, sizeof(note), 0 },
+        { JSON_QUERY_NUMBER, missing, 4, 0, 0 },
+    };
+    
+    // Running twice gives the same result
+    for (int run = 0; run < 2; run++) {
+        assert(json_query_run(query, json, strlen(json), fields) == 0);
+        assert(fields[0].count == 1 && strcmp(name, "Lisboa") == 0);
+        assert(fields[1].count == 1 && lat == 38.7);
+        assert(fields[2].count == 2 && strcmp(times[0], "2024-01-01") == 0 &&
+               strcmp(times[1], "2024-01-02") == 0);
+        assert(fields[3].count == 3 && temps[0] == 12.5 && isnan(temps[1]) && temps[2] == 14);
+        assert(fields[4].count == 1 && strcmp(note, "a long") == 0);
+        assert(fields[5].count == 0);
+    }
+    
+    const char* truncated = "{\"daily\": {\"time\": [1,";
+    assert(json_query_run(query, truncated, strlen(truncated), fields) == -1);
+    assert(json_query_run(query, "{} []", 5, fields) == -1);
+    json_query_free(query);
+    
+    const char* bad[] = { "", ".a", "a..b", "a[", "a[x]", "a[1" };
+    assert(json_query_compile(bad, 1) == NULL);
+    assert(json_query_compile(bad + 1, 1) == NULL);
+    assert(json_query_compile(bad + 2, 1) == NULL);
+    assert(json_query_compile(bad + 3, 1) == NULL);
+    assert(json_query_compile(bad + 4, 1) == NULL);
+    assert(json_query_compile(bad + 5, 1) == NULL);
+    const char* dup[] = { "a.b", "a.b" };
+    assert(json_query_compile(dup, 2) == NULL);
+}
+
 // Core Tests
 TEST(celsius_to_fahrenheit_conversion) {
     Celsius c = {0.0};
@@ -123,6 +917,920 @@ TEST(weather_description_codes) {
     assert(strcmp(get_weather_description(999), "Unknown") == 0);
 }
 
+// HTTP Client Tests
+TEST(http_keep_alive_reuses_connection) {
+    TestServer srv = start_test_server(handler_keep_alive);
+    assert(fetch_conn_index(srv.port) == 1);
+    assert(fetch_conn_index(srv.port) == 1);
+    assert(fetch_conn_index(srv.port) == 1);
+    stop_test_server(&srv);
+}
+
+TEST(http_reconnects_after_server_close) {
+    TestServer srv = start_test_server(handler_close_after_one);
+    assert(fetch_conn_index(srv.port) == 1);
+    usleep(50000); // let the server's FIN arrive
+    assert(fetch_conn_index(srv.port) == 2);
+    assert(fetch_conn_index(srv.port) == 3);
+    stop_test_server(&srv);
+}
+
+TEST(http_large_framed_bodies) {
+    TestServer srv = start_test_server(handler_large_body);
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/", srv.port);
+    
+    for (int round = 0; round < 3; round++) {
+        char* body = http_get(url);
+        assert(body != NULL);
+        assert(strlen(body) == LARGE_BODY_SIZE);
+        for (size_t i = 0; i < LARGE_BODY_SIZE; i++) assert(body[i] == 'a' + (char)(i % 26));
+        free(body);
+    }
+    stop_test_server(&srv);
+}
+
+TEST(http_chunked_decoding) {
+    TestServer srv = start_test_server(handler_chunked_tricky);
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/", srv.port);
+    
+    for (int round = 0; round < 2; round++) {
+        HttpRequest req = { .url = url };
+        assert(http_get_many(&req, 1, 1, NULL, NULL) == 1);
+        assert(req.body_len == 15);
+        assert(memcmp(req.body, "ab\0cd0123456789", 15) == 0);
+        assert(req.body[15] == '\0');
+        free(req.body);
+    }
+    stop_test_server(&srv);
+}
+
+TEST(inflate_gzip_byte_by_byte) {
+    Inflater* inf = inflater_new(INFLATE_GZIP);
+    InflateStatus st = INFLATE_NEED_MORE;
+    for (size_t i = 0; i < sizeof(forecast_gz); i++) {
+        assert(st == INFLATE_NEED_MORE);
+        st = inflater_feed(inf, forecast_gz + i, 1);
+    }
+    assert(st == INFLATE_DONE);
+    size_t len;
+    char* out = inflater_take_output(inf, &len);
+    assert(len == strlen(forecast_json));
+    assert(strcmp(out, forecast_json) == 0);
+    free(out);
+    inflater_free(inf);
+}
+
+TEST(inflate_zlib_stored_and_corrupt) {
+    Inflater* inf = inflater_new(INFLATE_AUTO);
+    assert(inflater_feed(inf, stored_zlib, sizeof(stored_zlib)) == INFLATE_DONE);
+    size_t len;
+    char* out = inflater_take_output(inf, &len);
+    assert(len == 33);
+    assert(strncmp(out, "stored block aaaa", 17) == 0);
+    free(out);
+    inflater_free(inf);
+    
+    // A flipped payload byte must fail the Adler-32 check
+    unsigned char bad[sizeof(stored_zlib)];
+    memcpy(bad, stored_zlib, sizeof(bad));
+    bad[20] ^= 1;
+    inf = inflater_new(INFLATE_ZLIB);
+    assert(inflater_feed(inf, bad, sizeof(bad)) == INFLATE_ERROR);
+    inflater_free(inf);
+}
+
+TEST(http_gzip_response) {
+    TestServer srv = start_test_server(handler_gzip);
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/", srv.port);
+    for (int round = 0; round < 2; round++) {
+        char* body = http_get(url);
+        assert(body != NULL);
+        assert(strcmp(body, forecast_json) == 0);
+        free(body);
+    }
+    stop_test_server(&srv);
+}
+
+// Feeds each piece of a streamed body straight into a JSON reader
+typedef struct {
+    JsonReader* reader;
+    int chunks;
+    int numbers;
+    double max_sum;
+    int in_max;
+    int failed;
+} StreamState;
+
+static int stream_into_reader(const char* data, size_t len, void* user_data) {
+    StreamState* st = user_data;
+    st->chunks++;
+    json_reader_feed(st->reader, data, len);
+    JsonToken tok;
+    JsonTokenType type;
+    while ((type = json_reader_next(st->reader, &tok)) != JSON_TOKEN_NEED_MORE) {
+        if (type == JSON_TOKEN_ERROR) st->failed = 1;
+        if (type == JSON_TOKEN_ERROR || type == JSON_TOKEN_END) break;
+        if (type == JSON_TOKEN_KEY) st->in_max = strcmp(tok.string, "temperature_2m_max") == 0;
+        if (type == JSON_TOKEN_NUMBER) {
+            st->numbers++;
+            if (st->in_max) st->max_sum += tok.number;
+        }
+    }
+    return st->failed;
+}
+
+TEST(http_stream_feeds_json_reader) {
+    TestServer srv = start_test_server(handler_gzip);
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/", srv.port);
+    
+    // Content-Length framed first, then dribbled out in 40-byte chunks
+    for (int round = 0; round < 2; round++) {
+        StreamState st = { json_reader_new(), 0, 0, 0.0, 0, 0 };
+        assert(http_get_stream(url, stream_into_reader, &st) == 0);
+        json_reader_finish(st.reader);
+        JsonToken tok;
+        assert(json_reader_next(st.reader, &tok) == JSON_TOKEN_END);
+        assert(st.numbers == 21);
+        assert(st.max_sum > 150.29 && st.max_sum < 150.31);
+        if (round == 1) assert(st.chunks > 1);
+        json_reader_free(st.reader);
+    }
+    stop_test_server(&srv);
+}
+
+TEST(dns_resolve_caches_addresses) {
+    DnsAddress first[DNS_MAX_ADDRS], second[DNS_MAX_ADDRS];
+    int n1 = dns_resolve("localhost", 8080, first, DNS_MAX_ADDRS);
+    assert(n1 > 0);
+    int n2 = dns_resolve("localhost", 9090, second, DNS_MAX_ADDRS);
+    assert(n2 == n1);
+    for (int i = 0; i < n1; i++) {
+        assert(first[i].addr.ss_family == second[i].addr.ss_family);
+        int port = first[i].addr.ss_family == AF_INET6
+            ? ntohs(((struct sockaddr_in6*)&second[i].addr)->sin6_port)
+            : ntohs(((struct sockaddr_in*)&second[i].addr)->sin_port);
+        assert(port == 9090);
+    }
+    dns_cache_clear();
+}
+
+TEST(http_connects_by_hostname) {
+    // Server listens on IPv4 only; an IPv6 localhost entry must fall through
+    TestServer srv = start_test_server(handler_keep_alive);
+    char url[64];
+    snprintf(url, sizeof(url), "http://localhost:%d/", srv.port);
+    char* body = http_get(url);
+    assert(body != NULL);
+    assert(strstr(body, "\"conn\"") != NULL);
+    free(body);
+    stop_test_server(&srv);
+}
+
+static void count_completion(HttpRequest* req, void* user_data) {
+    (void)req;
+    (*(int*)user_data)++;
+}
+
+TEST(http_get_many_runs_concurrently) {
+    TestServer srv = start_test_server(handler_slow);
+    char urls[8][64];
+    HttpRequest reqs[9];
+    for (int i = 0; i < 8; i++) {
+        snprintf(urls[i], sizeof(urls[i]), "http://127.0.0.1:%d/item/%d", srv.port, i);
+        reqs[i].url = urls[i];
+    }
+    reqs[8].url = "https://127.0.0.1/unsupported";
+    
+    struct timespec t0, t1;
+    int completed = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int ok = http_get_many(reqs, 9, 8, count_completion, &completed);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    
+    assert(ok == 8);
+    assert(completed == 9);
+    assert(elapsed < 0.8); // serial would take 1.6s
+    for (int i = 0; i < 8; i++) {
+        assert(reqs[i].error == NULL);
+        assert(reqs[i].status == 200);
+        assert(strstr(reqs[i].body, "\"conn\"") != NULL);
+        free(reqs[i].body);
+    }
+    assert(reqs[8].body == NULL);
+    assert(reqs[8].error != NULL);
+    stop_test_server(&srv);
+}
+
+TEST(http_pipelined_in_order_with_fallback) {
+    TestServer srv = start_test_server(handler_pipelined);
+    char urls[8][64];
+    HttpRequest reqs[8];
+    for (int i = 0; i < 8; i++) {
+        snprintf(urls[i], sizeof(urls[i]), "http://127.0.0.1:%d/item/%d", srv.port, i);
+        reqs[i].url = urls[i];
+    }
+    
+    assert(http_get_pipelined(reqs, 8) == 8);
+    for (int i = 0; i < 8; i++) {
+        char expected[32];
+        snprintf(expected, sizeof(expected), "\"/item/%d\"", i);
+        assert(reqs[i].status == 200);
+        assert(strstr(reqs[i].body, expected) != NULL);
+        // The first five share a connection; the server then hangs up
+        if (i < 5) assert(strstr(reqs[i].body, "\"conn\": 1,") != NULL);
+        free(reqs[i].body);
+    }
+    stop_test_server(&srv);
+}
+
+TEST(http_deadline_then_retry) {
+    TestServer srv = start_test_server(handler_stall_first);
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/", srv.port);
+    
+    HttpOptions opts;
+    http_get_options(&opts);
+    opts.first_byte_timeout_ms = 200;
+    opts.backoff_base_ms = 10;
+    opts.max_retries = 0;
+    http_set_options(&opts);
+    
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    assert(http_get(url) == NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    assert((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9 < 1.0);
+    
+    // The retry lands on a fresh connection that answers
+    opts.max_retries = 2;
+    http_set_options(&opts);
+    assert(fetch_conn_index(srv.port) == 2);
+    
+    http_set_options(NULL);
+    stop_test_server(&srv);
+}
+
+TEST(http_hedged_request_wins) {
+    TestServer srv = start_test_server(handler_stall_first);
+    HttpOptions opts;
+    http_get_options(&opts);
+    opts.hedge_delay_ms = 100;
+    opts.max_retries = 0;
+    http_set_options(&opts);
+    
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    assert(fetch_conn_index(srv.port) == 2);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    assert((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9 < 1.0);
+    
+    http_set_options(NULL);
+    stop_test_server(&srv);
+}
+
+// Singleflight: eight threads ask for the same key while the first is busy
+#define FLIGHT_THREADS 8
+
+static FlightGroup test_flights = FLIGHT_GROUP_INIT;
+static pthread_barrier_t flight_barrier;
+static int flight_calls = 0;
+
+static void* slow_value(void* arg) {
+    (void)arg;
+    __sync_fetch_and_add(&flight_calls, 1);
+    usleep(200000);
+    return strdup_safe("value");
+}
+
+static void* copy_string(const void* s) {
+    return strdup_safe(s);
+}
+
+typedef struct {
+    const char* url;   // NULL runs flight_do directly
+    char* result;
+    int shared;
+} FlightCaller;
+
+static void* flight_caller(void* arg) {
+    FlightCaller* caller = arg;
+    pthread_barrier_wait(&flight_barrier);
+    if (caller->url) {
+        caller->result = http_get(caller->url);
+    } else {
+        caller->result = flight_do(&test_flights, "key", slow_value, NULL, copy_string,
+                                   &caller->shared);
+    }
+    return NULL;
+}
+
+static void run_flight_callers(FlightCaller* callers) {
+    pthread_t threads[FLIGHT_THREADS];
+    pthread_barrier_init(&flight_barrier, NULL, FLIGHT_THREADS);
+    for (int i = 0; i < FLIGHT_THREADS; i++) {
+        pthread_create(&threads[i], NULL, flight_caller, &callers[i]);
+    }
+    for (int i = 0; i < FLIGHT_THREADS; i++) pthread_join(threads[i], NULL);
+    pthread_barrier_destroy(&flight_barrier);
+}
+
+TEST(singleflight_coalesces_callers) {
+    FlightCaller callers[FLIGHT_THREADS] = { { 0 } };
+    run_flight_callers(callers);
+    
+    int shared = 0;
+    for (int i = 0; i < FLIGHT_THREADS; i++) {
+        assert(strcmp(callers[i].result, "value") == 0);
+        shared += callers[i].shared;
+        free(callers[i].result);
+    }
+    assert(flight_calls == 1);
+    assert(shared == FLIGHT_THREADS - 1);
+}
+
+TEST(http_get_coalesces_duplicate_urls) {
+    TestServer srv = start_test_server(handler_slow);
+    char url[64], upper[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/same", srv.port);
+    snprintf(upper, sizeof(upper), "HTTP://127.0.0.1:%d/same", srv.port);
+    
+    FlightCaller callers[FLIGHT_THREADS] = { { 0 } };
+    for (int i = 0; i < FLIGHT_THREADS; i++) callers[i].url = i % 2 ? upper : url;
+    run_flight_callers(callers);
+    
+    // One request, one connection: every caller sees connection 1
+    for (int i = 0; i < FLIGHT_THREADS; i++) {
+        assert(callers[i].result != NULL);
+        assert(strcmp(callers[i].result, "{\"conn\": 1}") == 0);
+        free(callers[i].result);
+    }
+    stop_test_server(&srv);
+}
+
+// Cache Tests
+
+// Rewrites one city over and over; every value it writes has lon == 2 * lat
+static void* geocache_writer(void* arg) {
+    GeoCache* cache = arg;
+    for (int i = 1; i <= 2000; i++) {
+        Location loc = { { i }, { 2.0 * i }, "Busy", "Nowhere" };
+        geocache_store(cache, "busy", &loc);
+    }
+    return NULL;
+}
+
+TEST(geocache_persists_and_shares) {
+    char path[] = "/tmp/geocache-test-XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    
+    GeoCache* cache = geocache_open(path);
+    assert(cache != NULL);
+    Location loc;
+    assert(geocache_lookup(cache, "Berlin", &loc) == GEOCACHE_MISS);
+    
+    Location berlin = { { 52.52 }, { 13.41 }, "Berlin", "Germany" };
+    geocache_store(cache, "Berlin", &berlin);
+    geocache_store(cache, "Atlantis", NULL);
+    
+    // A second handle stands in for another process mapping the same file
+    GeoCache* other = geocache_open(path);
+    assert(other != NULL);
+    assert(geocache_lookup(other, "  berLIN ", &loc) == GEOCACHE_FOUND);
+    assert(loc.lat.value == 52.52 && loc.lon.value == 13.41);
+    assert(strcmp(loc.name, "Berlin") == 0 && strcmp(loc.country, "Germany") == 0);
+    free(loc.name);
+    free(loc.country);
+    assert(geocache_lookup(other, "atlantis", &loc) == GEOCACHE_NOT_FOUND);
+    assert(geocache_lookup(other, "New York", &loc) == GEOCACHE_MISS);
+    
+    // Readers never see a half-written slot
+    pthread_t writer;
+    pthread_create(&writer, NULL, geocache_writer, cache);
+    for (int i = 0; i < 2000; i++) {
+        if (geocache_lookup(other, "busy", &loc) == GEOCACHE_FOUND) {
+            assert(loc.lon.value == 2.0 * loc.lat.value);
+            free(loc.name);
+            free(loc.country);
+        }
+    }
+    pthread_join(writer, NULL);
+    geocache_close(other);
+    
+    // Reopening keeps entries; a damaged header starts the table over
+    geocache_close(cache);
+    cache = geocache_open(path);
+    assert(geocache_lookup(cache, "berlin", &loc) == GEOCACHE_FOUND);
+    free(loc.name);
+    free(loc.country);
+    geocache_close(cache);
+    
+    fd = open(path, O_WRONLY);
+    assert(write(fd, "garbage!", 8) == 8);
+    close(fd);
+    cache = geocache_open(path);
+    assert(cache != NULL);
+    assert(geocache_lookup(cache, "berlin", &loc) == GEOCACHE_MISS);
+    geocache_close(cache);
+    unlink(path);
+}
+
+// Read one request head and keep its path; 0 when the client closed
+static int read_request_path(int fd, char* path, size_t size) {
+    char buf[4096];
+    size_t len = 0;
+    while (len < sizeof(buf) - 1) {
+        ssize_t n = read(fd, buf + len, 1);
+        if (n <= 0) return 0;
+        len += n;
+        if (len >= 4 && memcmp(buf + len - 4, "\r\n\r\n", 4) == 0) {
+            buf[len] = '\0';
+            char format[32];
+            snprintf(format, sizeof(format), "GET %%%zus", size - 1);
+            return sscanf(buf, format, path) == 1;
+        }
+    }
+    return 0;
+}
+
+static void reply_json(int fd, const char* body) {
+    char head[128];
+    snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n\r\n", strlen(body));
+    send_str(fd, head);
+    send_str(fd, body);
+}
+
+// A geocoder that knows every city but Nowhere, and places them all in Testville
+static void handler_geocoder(int fd, int conn_index) {
+    (void)conn_index;
+    char path[512];
+    while (read_request_path(fd, path, sizeof(path))) {
+        if (strstr(path, "name=Nowhere")) {
+            reply_json(fd, "{\"generationtime_ms\": 0.1}");
+        } else {
+            reply_json(fd, "{\"results\": [{\"name\": \"Testville\", \"latitude\": 12.5,"
+                           " \"longitude\": -45.25, \"country\": \"Testland\"}]}");
+        }
+    }
+}
+
+TEST(find_location_cache_before_network) {
+    char cache_path[] = "/tmp/geocache-find-XXXXXX";
+    int fd = mkstemp(cache_path);
+    assert(fd >= 0);
+    close(fd);
+    setenv("WEATHER_GEOCACHE", cache_path, 1);
+    GeoCache* cache = geocache_default();
+    assert(cache != NULL);
+    
+    TestServer srv = start_test_server(handler_geocoder);
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/v1/search", srv.port);
+    setenv("WEATHER_GEOCODING_URL", url, 1);
+    
+    // Cached answers win over the geocoder, negative ones included
+    Location cached = { { 1.5 }, { 2.5 }, "Cachetown", "Cacheland" };
+    geocache_store(cache, "Cachetown", &cached);
+    geocache_store(cache, "Ghost Town", NULL);
+    Location* loc = find_location("cachetown");
+    assert(loc && loc->lat.value == 1.5 && loc->lon.value == 2.5);
+    assert(strcmp(loc->name, "Cachetown") == 0);
+    location_free(loc);
+    assert(find_location("Ghost Town") == NULL);
+    
+    // Built-in cities are answered before the cache is consulted
+    Location stale = { { 0.0 }, { 0.0 }, "Paris", "Nowhere" };
+    geocache_store(cache, "Paris", &stale);
+    loc = find_location("PARIS");
+    assert(loc && loc->lat.value == 48.8534 && loc->lon.value == 2.3488);
+    assert(strcmp(loc->country, "France") == 0);
+    location_free(loc);
+    
+    // A miss goes to the network, and its answer, found or not, is cached
+    Location out;
+    assert(geocache_lookup(cache, "Springfield", &out) == GEOCACHE_MISS);
+    loc = find_location("Springfield");
+    assert(loc && loc->lat.value == 12.5 && loc->lon.value == -45.25);
+    assert(strcmp(loc->name, "Testville") == 0 && strcmp(loc->country, "Testland") == 0);
+    location_free(loc);
+    assert(geocache_lookup(cache, "Springfield", &out) == GEOCACHE_FOUND);
+    assert(out.lat.value == 12.5);
+    free(out.name);
+    free(out.country);
+    assert(find_location("Nowhere") == NULL);
+    assert(geocache_lookup(cache, "Nowhere", &out) == GEOCACHE_NOT_FOUND);
+    
+    // Once cached, the server is no longer needed
+    stop_test_server(&srv);
+    loc = find_location("Springfield");
+    assert(loc && strcmp(loc->name, "Testville") == 0);
+    location_free(loc);
+    
+    unsetenv("WEATHER_GEOCODING_URL");
+    unlink(cache_path);
+}
+
+static Forecast* make_forecast(const char* name, size_t days) {
+    Forecast* fc = malloc_safe(sizeof(Forecast));
+    fc->location.lat.value = 1.0;
+    fc->location.lon.value = 2.0;
+    fc->location.name = strdup_safe(name);
+    fc->location.country = strdup_safe("Testland");
+    fc->daily_count = days;
+    fc->daily = malloc_safe(days * sizeof(DailyForecast));
+    for (size_t i = 0; i < days; i++) {
+        fc->daily[i].date = strdup_safe("2024-01-01");
+        fc->daily[i].weather_code = (int)i;
+        fc->daily[i].max_temp.value = 20.0 + i;
+        fc->daily[i].min_temp.value = 10.0 + i;
+    }
+    return fc;
+}
+
+TEST(forecast_cache_lru_and_expiry) {
+    Forecast* a = make_forecast("A", 7);
+    Forecast* b = make_forecast("B", 7);
+    Forecast* c = make_forecast("C", 7);
+    
+    // Room for two entries, not three
+    ForecastCache* probe = forecast_cache_new(1 << 20, 3600);
+    forecast_cache_put(probe, "a", a, 0);
+    size_t one = forecast_cache_size(probe);
+    forecast_cache_free(probe);
+    ForecastCache* cache = forecast_cache_new(2 * one + one / 2, 3600);
+    
+    // Hits are independent copies until the next hourly boundary
+    forecast_cache_put(cache, "a", a, 1000);
+    Forecast* got = forecast_cache_get(cache, "a", 3599);
+    assert(got != NULL && got != a);
+    assert(strcmp(got->location.name, "A") == 0 && got->daily_count == 7);
+    assert(got->daily[3].max_temp.value == 23.0 && got->daily[3].date != a->daily[3].date);
+    forecast_free(got);
+    assert(forecast_cache_get(cache, "a", 3600) == NULL);
+    assert(forecast_cache_size(cache) == 0);
+    
+    // Touching a makes b the one to go when c arrives
+    forecast_cache_put(cache, "a", a, 0);
+    forecast_cache_put(cache, "b", b, 0);
+    forecast_free(forecast_cache_get(cache, "a", 1));
+    forecast_cache_put(cache, "c", c, 2);
+    assert(forecast_cache_get(cache, "b", 3) == NULL);
+    got = forecast_cache_get(cache, "a", 3);
+    assert(got != NULL);
+    forecast_free(got);
+    got = forecast_cache_get(cache, "c", 3);
+    assert(got != NULL && strcmp(got->location.name, "C") == 0);
+    forecast_free(got);
+    assert(forecast_cache_size(cache) <= 2 * one + one / 2);
+    
+    // Replacing a key doesn't double-charge it; oversized entries are skipped
+    forecast_cache_put(cache, "c", c, 4);
+    assert(forecast_cache_size(cache) == 2 * one);
+    Forecast* big = make_forecast("Big", 1000);
+    forecast_cache_put(cache, "big", big, 5);
+    assert(forecast_cache_get(cache, "big", 5) == NULL);
+    
+    forecast_cache_free(cache);
+    forecast_free(a);
+    forecast_free(b);
+    forecast_free(c);
+    forecast_free(big);
+}
+
+TEST(get_forecast_answers_repeats_from_cache) {
+    TestServer srv = start_test_server(handler_gzip);
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/v1/forecast", srv.port);
+    setenv("WEATHER_FORECAST_URL", url, 1);
+    
+    Location oslo = { { 59.91 }, { 10.75 }, "Oslo", "Norway" };
+    Forecast* first = get_forecast(&oslo);
+    assert(first != NULL && first->daily_count == 7);
+    assert(first->daily[0].max_temp.value == 21.4);
+    
+    // The server is gone, so only the cache can answer
+    stop_test_server(&srv);
+    Forecast* again = get_forecast(&oslo);
+    assert(again != NULL && again->daily_count == 7);
+    assert(strcmp(again->daily[6].date, "2024-06-07") == 0);
+    assert(again->daily[6].min_temp.value == 13.0);
+    assert(strcmp(again->location.name, "Oslo") == 0);
+    forecast_free(first);
+    forecast_free(again);
+    
+    unsetenv("WEATHER_FORECAST_URL");
+}
+
+// Publishes one key over and over; every day written has min == -max
+static void* shm_writer(void* arg) {
+    ShmCache* cache = arg;
+    Forecast* fc = make_forecast("Busy", 7);
+    for (int i = 1; i <= 2000; i++) {
+        for (size_t d = 0; d < fc->daily_count; d++) {
+            fc->daily[d].max_temp.value = i + d;
+            fc->daily[d].min_temp.value = -(double)(i + d);
+        }
+        shm_cache_put(cache, "busy", fc, 100);
+    }
+    forecast_free(fc);
+    return NULL;
+}
+
+TEST(shm_cache_shared_across_processes) {
+    char name[64];
+    snprintf(name, sizeof(name), "/weather-c-test-%d", (int)getpid());
+    ShmCache* cache = shm_cache_open(name);
+    assert(cache != NULL);
+    assert(shm_cache_get(cache, "paris", 10) == NULL);
+    
+    // The first process to ask fetches; the rest wait for its result
+    assert(shm_cache_claim(cache, "paris", 10) == 1);
+    assert(shm_cache_claim(cache, "paris", 11) == 0);
+    assert(shm_cache_get(cache, "paris", 11) == NULL);
+    
+    pid_t pid = fork();
+    if (pid == 0) {
+        ShmCache* child = shm_cache_open(name);
+        Forecast* fc = make_forecast("Paris", 7);
+        shm_cache_put(child, "paris", fc, 100);
+        _exit(child ? 0 : 1);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    
+    Forecast* got = shm_cache_get(cache, "paris", 99);
+    assert(got != NULL);
+    assert(strcmp(got->location.name, "Paris") == 0 && got->daily_count == 7);
+    assert(got->daily[6].max_temp.value == 26.0 && strcmp(got->daily[6].date, "2024-01-01") == 0);
+    forecast_free(got);
+    assert(shm_cache_get(cache, "paris", 100) == NULL);
+    
+    // An abandoned claim lapses after its lease
+    assert(shm_cache_claim(cache, "lyon", 10) == 1);
+    assert(shm_cache_claim(cache, "lyon", 10 + SHM_CACHE_LEASE) == 1);
+    
+    // A failed fetch hands its claim straight on
+    assert(shm_cache_claim(cache, "nice", 10) == 1);
+    shm_cache_release(cache, "nice");
+    assert(shm_cache_get(cache, "nice", 11) == NULL);
+    assert(shm_cache_claim(cache, "nice", 11) == 1);
+    
+    // Readers in another mapping never see a half-written slot
+    ShmCache* other = shm_cache_open(name);
+    pthread_t writer;
+    pthread_create(&writer, NULL, shm_writer, cache);
+    for (int i = 0; i < 2000; i++) {
+        got = shm_cache_get(other, "busy", 50);
+        if (!got) continue;
+        for (size_t d = 0; d < got->daily_count; d++) {
+            assert(got->daily[d].min_temp.value == -got->daily[d].max_temp.value);
+        }
+        forecast_free(got);
+    }
+    pthread_join(writer, NULL);
+    
+    shm_cache_close(other);
+    shm_cache_close(cache);
+    assert(shm_cache_unlink(name) == 0);
+}
+
+TEST(gazetteer_perfect_hash_lookup) {
+    // Minimal: one slot per key, and every key finds its own slot
+    assert(gazetteer_count > 100);
+    for (size_t i = 0; i < gazetteer_count; i++) {
+        const GazetteerEntry* e = &gazetteer_entries[i];
+        uint32_t seed = gazetteer_displace[gazetteer_hash(e->key, 0) % gazetteer_bucket_count];
+        assert(gazetteer_hash(e->key, seed) % gazetteer_count == i);
+    }
+    
+    Location loc;
+    assert(gazetteer_lookup("  new   YORK ", &loc));
+    assert(strcmp(loc.name, "New York") == 0 && strcmp(loc.country, "United States") == 0);
+    assert(fabs(loc.lat.value - 40.7143) < 1e-9 && fabs(loc.lon.value + 74.006) < 1e-9);
+    free(loc.name);
+    free(loc.country);
+    
+    // Aliases resolve to the city's own name
+    assert(gazetteer_lookup("Sao Paulo", &loc));
+    assert(strcmp(loc.name, "S\xc3\xa3o Paulo") == 0);
+    free(loc.name);
+    free(loc.country);
+    
+    assert(!gazetteer_lookup("Atlantis", &loc));
+    assert(!gazetteer_lookup("new yor", &loc));
+    assert(!gazetteer_lookup("   ", &loc));
+}
+
+TEST(gazetteer_nearest_place) {
+    // The tree agrees with a linear scan everywhere on a global grid
+    for (double lat = -89.5; lat < 90.0; lat += 7.0) {
+        for (double lon = -179.5; lon < 180.0; lon += 7.0) {
+            double km;
+            const GazetteerPlace* got = gazetteer_nearest(lat, lon, &km);
+            double phi = lat * M_PI / 180.0, lambda = lon * M_PI / 180.0;
+            double q[3] = { cos(phi) * cos(lambda), cos(phi) * sin(lambda), sin(phi) };
+            double best = INFINITY;
+            for (size_t i = 0; i < gazetteer_place_count; i++) {
+                const double* p = gazetteer_places[i].xyz;
+                double d2 = (q[0] - p[0]) * (q[0] - p[0]) + (q[1] - p[1]) * (q[1] - p[1]) +
+                            (q[2] - p[2]) * (q[2] - p[2]);
+                if (d2 < best) best = d2;
+            }
+            const double* p = got->xyz;
+            double d2 = (q[0] - p[0]) * (q[0] - p[0]) + (q[1] - p[1]) * (q[1] - p[1]) +
+                        (q[2] - p[2]) * (q[2] - p[2]);
+            assert(d2 == best);
+            assert(km >= 0.0 && km <= 20040.0);
+        }
+    }
+    
+    // Across the antimeridian, and named for the point asked about
+    double km;
+    assert(strcmp(gazetteer_nearest(-41.3, -179.9, &km)->name, "Wellington") == 0);
+    Location* loc = find_nearest_location((Latitude){ 52.52 }, (Longitude){ 13.40 });
+    assert(strcmp(loc->name, "Berlin") == 0 && strcmp(loc->country, "Germany") == 0);
+    assert(loc->lat.value == 52.52 && loc->lon.value == 13.40);
+    location_free(loc);
+    loc = find_nearest_location((Latitude){ 53.0 }, (Longitude){ 14.5 });
+    assert(strcmp(loc->name, "Near Berlin") == 0);
+    location_free(loc);
+}
+
+TEST(grid_snaps_nearby_points) {
+    GridSpec spec;
+    char key[GRID_KEY_MAX], other[GRID_KEY_MAX];
+    double lat, lon, lat2, lon2;
+    
+    assert(grid_parse("0.1", &spec) == 0 && spec.kind == GRID_DEGREES);
+    assert(grid_parse("geohash:5", &spec) == 0 && spec.precision == 5);
+    assert(grid_parse("none", &spec) == 0 && spec.kind == GRID_NONE);
+    assert(grid_parse("0", &spec) < 0 && grid_parse("geohash:13", &spec) < 0);
+    assert(grid_parse("0.1deg", &spec) < 0);
+    
+    // Known geohash; its cell's centre lies within half a cell of the point
+    char hash[GEOHASH_MAX + 1];
+    geohash_encode(57.64911, 10.40744, 11, hash);
+    assert(strcmp(hash, "u4pruydqqvj") == 0);
+    grid_parse("geohash:5", &spec);
+    grid_snap(&spec, 57.64911, 10.40744, key, &lat, &lon);
+    assert(strcmp(key, "h:u4pru") == 0);
+    assert(fabs(lat - 57.64911) <= 0.022 && fabs(lon - 10.40744) <= 0.022);
+    
+    // Stations 50 m apart share a cell and its centre; 180 and -180 do too
+    grid_parse("0.1", &spec);
+    grid_snap(&spec, 52.5200, 13.4050, key, &lat, &lon);
+    grid_snap(&spec, 52.5204, 13.4054, other, &lat2, &lon2);
+    assert(strcmp(key, other) == 0 && lat == lat2 && lon == lon2);
+    assert(fabs(lat - 52.55) < 1e-9 && fabs(lon - 13.45) < 1e-9);
+    grid_snap(&spec, 10.0, 180.0, key, &lat, &lon);
+    grid_snap(&spec, 10.0, -179.99, other, &lat2, &lon2);
+    assert(strcmp(key, other) == 0);
+    
+    // A dense network of distinct points collapses to a few cells
+    char keys[1000][GRID_KEY_MAX];
+    size_t distinct = 0;
+    for (int i = 0; i < 1000; i++) {
+        double plat = 48.0 + (i % 40) * 0.0125, plon = 2.0 + (i / 40) * 0.02;
+        grid_snap(&spec, plat, plon, key, &lat, &lon);
+        size_t j = 0;
+        while (j < distinct && strcmp(keys[j], key) != 0) j++;
+        if (j == distinct) strcpy(keys[distinct++], key);
+    }
+    assert(distinct <= 36);
+    
+    // Without a grid, coordinates pass through untouched
+    grid_parse("none", &spec);
+    grid_snap(&spec, 52.52004, 13.40502, key, &lat, &lon);
+    assert(strcmp(key, "52.5200,13.4050") == 0 && lat == 52.52004 && lon == 13.40502);
+    grid_snap(&spec, 52.5230, 13.4080, other, &lat2, &lon2);
+    assert(strcmp(key, other) != 0);
+}
+
+// Stands in for forecast_refresh, counting calls
+static pthread_mutex_t refresh_test_lock = PTHREAD_MUTEX_INITIALIZER;
+static int refresh_calls;
+
+static int count_refresh(Location* location) {
+    pthread_mutex_lock(&refresh_test_lock);
+    if (strcmp(location->name, "Berlin") == 0) refresh_calls++;
+    pthread_mutex_unlock(&refresh_test_lock);
+    return 0;
+}
+
+static int wait_for_refreshes(int want) {
+    for (int i = 0; i < 2000; i++) {
+        pthread_mutex_lock(&refresh_test_lock);
+        int calls = refresh_calls;
+        pthread_mutex_unlock(&refresh_test_lock);
+        if (calls >= want) return calls;
+        usleep(1000);
+    }
+    return refresh_calls;
+}
+
+TEST(refresh_serves_stale_and_revalidates) {
+    // Refreshes land in a jittered window before the next model update,
+    // or the one after if that window has already begun
+    unsigned int seed = 1;
+    time_t first = refresh_due_after(1000, 3600, &seed), spread = 0;
+    for (int i = 0; i < 1000; i++) {
+        time_t due = refresh_due_after(1000, 3600, &seed);
+        assert(due >= 3600 - REFRESH_LEAD && due < 3600);
+        if (due != first) spread = 1;
+        due = refresh_due_after(3500, 3600, &seed);
+        assert(due >= 7200 - REFRESH_LEAD && due < 7200);
+    }
+    assert(spread);
+    for (time_t now = 0; now < 10; now++) {
+        assert(refresh_due_after(now, 1, &seed) > now);
+        assert(refresh_due_after(now, 3, &seed) > now);
+    }
+    
+    // Stale entries are still served to those who ask for them
+    ForecastCache* cache = forecast_cache_new(1 << 20, 3600);
+    Forecast* fc = make_forecast("Berlin", 3);
+    forecast_cache_put(cache, "k", fc, 0);
+    int stale = -1;
+    Forecast* got = forecast_cache_get_stale(cache, "k", 10, &stale);
+    assert(got != NULL && stale == 0);
+    forecast_free(got);
+    got = forecast_cache_get_stale(cache, "k", 4000, &stale);
+    assert(got != NULL && stale == 1);
+    forecast_free(got);
+    assert(forecast_cache_get(cache, "k", 4000) == NULL);
+    forecast_cache_free(cache);
+    forecast_free(fc);
+    
+    // A watched place is refreshed in the background when asked
+    Location berlin = { { 52.52 }, { 13.41 }, "Berlin", "Germany" };
+    assert(refresh_start(count_refresh, 3600) == 0);
+    assert(!refresh_watching(&berlin));
+    refresh_watch(&berlin);
+    assert(refresh_watching(&berlin));
+    usleep(20000);
+    assert(wait_for_refreshes(0) == 0);
+    refresh_revalidate(&berlin);
+    assert(wait_for_refreshes(1) == 1);
+    
+    refresh_unwatch(&berlin);
+    assert(!refresh_watching(&berlin));
+    refresh_revalidate(&berlin);
+    usleep(20000);
+    assert(wait_for_refreshes(1) == 1);
+    
+    refresh_watch(&berlin);
+    refresh_stop();
+    assert(!refresh_watching(&berlin));
+}
+
+TEST(get_forecast_serves_watched_stale) {
+    // Forecasts expire every second here, so one goes stale in the test
+    setenv("WEATHER_MODEL_CADENCE", "1", 1);
+    weather_cleanup();
+    TestServer srv = start_test_server(handler_gzip);
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/v1/forecast", srv.port);
+    setenv("WEATHER_FORECAST_URL", url, 1);
+    
+    Location berlin = { { 52.52 }, { 13.41 }, "Berlin", "Germany" };
+    Forecast* fc = get_forecast(&berlin);
+    assert(fc != NULL && fc->daily[0].max_temp.value == 21.4);
+    forecast_free(fc);
+    assert(refresh_start(count_refresh, forecast_cadence()) == 0);
+    refresh_watch(&berlin);
+    int calls = wait_for_refreshes(0);
+    
+    // With the server gone and the entry expired, the watched place is
+    // still answered at once, and a revalidation is under way
+    stop_test_server(&srv);
+    usleep(1100000);
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    fc = get_forecast(&berlin);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    assert(fc != NULL && fc->daily_count == 7);
+    assert(fc->daily[6].min_temp.value == 13.0);
+    assert((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9 < 0.1);
+    forecast_free(fc);
+    assert(wait_for_refreshes(calls + 1) > calls);
+    
+    // Unwatched, the same stale entry is no longer good enough
+    refresh_unwatch(&berlin);
+    assert(get_forecast(&berlin) == NULL);
+    
+    refresh_stop();
+    weather_cleanup();
+    unsetenv("WEATHER_MODEL_CADENCE");
+    unsetenv("WEATHER_FORECAST_URL");
+}
+
 // UI & TUI Tests
 TEST(ui_color_styling) {
     // Condition colors
@@ -158,12 +1866,55 @@ int main(void) {
     RUN_TEST(json_parse_array);
     RUN_TEST(json_parse_object);
     RUN_TEST(json_parse_nested);
+    RUN_TEST(json_parse_large_array);
+    RUN_TEST(json_arena_reuse);
+    RUN_TEST(json_object_hashed_lookup);
+    RUN_TEST(json_numeric_arrays_packed);
+    RUN_TEST(json_strings_insitu_and_escapes);
+    RUN_TEST(json_index_kernels_agree);
+    RUN_TEST(json_number_rounding_and_grammar);
+    RUN_TEST(json_serialize_text_and_binary);
+    RUN_TEST(json_binary_rejects_corrupt_images);
+    RUN_TEST(json_reader_resumes_across_chunks);
+    RUN_TEST(json_query_extracts_paths);
     
     // Core Tests
     printf("\nCore Tests:\n");
     RUN_TEST(celsius_to_fahrenheit_conversion);
     RUN_TEST(weather_description_codes);
     
+    // Cache Tests
+    printf("\nCache Tests:\n");
+    RUN_TEST(geocache_persists_and_shares);
+    RUN_TEST(find_location_cache_before_network);
+    RUN_TEST(forecast_cache_lru_and_expiry);
+    RUN_TEST(get_forecast_answers_repeats_from_cache);
+    RUN_TEST(shm_cache_shared_across_processes);
+    RUN_TEST(gazetteer_perfect_hash_lookup);
+    RUN_TEST(gazetteer_nearest_place);
+    RUN_TEST(grid_snaps_nearby_points);
+    RUN_TEST(refresh_serves_stale_and_revalidates);
+    RUN_TEST(get_forecast_serves_watched_stale);
+    
+    // HTTP Client Tests
+    printf("\nHTTP Client Tests:\n");
+    RUN_TEST(http_keep_alive_reuses_connection);
+    RUN_TEST(http_reconnects_after_server_close);
+    RUN_TEST(http_large_framed_bodies);
+    RUN_TEST(http_get_many_runs_concurrently);
+    RUN_TEST(http_pipelined_in_order_with_fallback);
+    RUN_TEST(http_deadline_then_retry);
+    RUN_TEST(http_hedged_request_wins);
+    RUN_TEST(singleflight_coalesces_callers);
+    RUN_TEST(http_get_coalesces_duplicate_urls);
+    RUN_TEST(http_chunked_decoding);
+    RUN_TEST(inflate_gzip_byte_by_byte);
+    RUN_TEST(inflate_zlib_stored_and_corrupt);
+    RUN_TEST(http_gzip_response);
+    RUN_TEST(http_stream_feeds_json_reader);
+    RUN_TEST(dns_resolve_caches_addresses);
+    RUN_TEST(http_connects_by_hostname);
+    
     // UI & TUI Tests
     printf("\nUI & TUI Tests:\n");
     RUN_TEST(ui_color_styling);
@@ -0,0 +1,308 @@
+// Build-time generator for the city gazetteer: reads data/cities.csv and
+// writes the C source of a minimally perfectly hashed table to stdout.
+//
+// The hash is hash-and-displace: keys are split into buckets by one hash,
+// then each bucket, largest first, gets the first seed that sends all its
+// keys to table slots no other key has taken.
+//
+// Each distinct place is also written into a k-d tree over points on the
+// unit sphere, laid out implicitly: a range's median is its root.
+
+#include "../include/gazetteer.h"
+#include "../include/core.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define MAX_ROWS 4096
+#define LINE_MAX_LEN 1024
+#define MAX_SEED (1u << 24)
+
+typedef struct {
+    char* key;
+    char* name;
+    char* country;
+    double lat;
+    double lon;
+    int alias;
+} Row;
+
+typedef struct {
+    const Row* row;
+    double xyz[3];
+    int axis;
+} Place;
+
+typedef struct {
+    size_t* keys;   // indices into rows
+    size_t count;
+    size_t index;   // bucket number before sorting
+} Bucket;
+
+static Row rows[MAX_ROWS];
+static size_t row_count;
+static Place places[MAX_ROWS];
+static size_t place_count;
+
+static char* trim(char* s) {
+    while (*s == ' ' || *s == '\t') s++;
+    size_t len = strlen(s);
+    while (len > 0 && (s[len - 1] == ' ' || s[len - 1] == '\t' ||
+                       s[len - 1] == '\r' || s[len - 1] == '\n')) {
+        s[--len] = '\0';
+    }
+    return s;
+}
+
+// Add one name for a city; later duplicates of a key are dropped
+static int add_row(const char* name, const char* display, const char* country,
+                   double lat, double lon, int alias, int line) {
+    char key[GAZETTEER_KEY_MAX];
+    if (!city_normalize(name, key, sizeof(key))) {
+        fprintf(stderr, "cities.csv:%d: bad name '%s'\n", line, name);
+        return -1;
+    }
+    for (size_t i = 0; i < row_count; i++) {
+        if (strcmp(rows[i].key, key) == 0) return 0;
+    }
+    if (row_count == MAX_ROWS) {
+        fprintf(stderr, "cities.csv:%d: more than %d names\n", line, MAX_ROWS);
+        return -1;
+    }
+    Row* row = &rows[row_count++];
+    row->key = strdup_safe(key);
+    row->name = strdup_safe(display);
+    row->country = strdup_safe(country);
+    row->lat = lat;
+    row->lon = lon;
+    row->alias = alias;
+    return 0;
+}
+
+static int read_rows(FILE* in) {
+    char line[LINE_MAX_LEN];
+    for (int number = 1; fgets(line, sizeof(line), in); number++) {
+        char* p = trim(line);
+        if (*p == '\0' || *p == '#') continue;
+        
+        char* fields[5] = { 0 };
+        for (int i = 0; i < 5; i++) {
+            fields[i] = p;
+            p = i < 4 ? strchr(p, ',') : NULL;
+            if (!p) break;
+            *p++ = '\0';
+        }
+        if (!fields[3]) {
+            fprintf(stderr, "cities.csv:%d: expected name,country,latitude,longitude\n", number);
+            return -1;
+        }
+        
+        char* lat_end;
+        char* lon_end;
+        double lat = strtod(fields[2], &lat_end);
+        double lon = strtod(fields[3], &lon_end);
+        if (lat_end == fields[2] || lon_end == fields[3]) {
+            fprintf(stderr, "cities.csv:%d: bad coordinates\n", number);
+            return -1;
+        }
+        char* name = trim(fields[0]);
+        char* country = trim(fields[1]);
+        if (add_row(name, name, country, lat, lon, 0, number) < 0) return -1;
+        
+        for (char* alias = fields[4]; alias && *alias; ) {
+            char* next = strchr(alias, '|');
+            if (next) *next++ = '\0';
+            alias = trim(alias);
+            if (*alias && add_row(alias, name, country, lat, lon, 1, number) < 0) return -1;
+            alias = next;
+        }
+    }
+    return 0;
+}
+
+static int by_size(const void* a, const void* b) {
+    const Bucket* x = a;
+    const Bucket* y = b;
+    if (x->count != y->count) return x->count < y->count ? 1 : -1;
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+// Fill displace and place[slot] = row; -1 if some bucket finds no seed
+static int build(uint32_t* displace, size_t bucket_count, size_t* place) {
+    Bucket* buckets = malloc_safe(bucket_count * sizeof(Bucket));
+    memset(buckets, 0, bucket_count * sizeof(Bucket));
+    for (size_t b = 0; b < bucket_count; b++) {
+        buckets[b].keys = malloc_safe(row_count * sizeof(size_t));
+        buckets[b].index = b;
+    }
+    for (size_t i = 0; i < row_count; i++) {
+        Bucket* b = &buckets[gazetteer_hash(rows[i].key, 0) % bucket_count];
+        b->keys[b->count++] = i;
+    }
+    qsort(buckets, bucket_count, sizeof(Bucket), by_size);
+    
+    char* taken = malloc_safe(row_count);
+    memset(taken, 0, row_count);
+    size_t* slots = malloc_safe(row_count * sizeof(size_t));
+    int rc = 0;
+    
+    for (size_t b = 0; b < bucket_count && rc == 0; b++) {
+        Bucket* bucket = &buckets[b];
+        displace[bucket->index] = 0;
+        if (bucket->count == 0) continue;
+        
+        uint32_t seed;
+        for (seed = 1; seed < MAX_SEED; seed++) {
+            size_t placed = 0;
+            for (; placed < bucket->count; placed++) {
+                size_t slot = gazetteer_hash(rows[bucket->keys[placed]].key, seed) % row_count;
+                if (taken[slot]) break;
+                taken[slot] = 1;
+                slots[placed] = slot;
+            }
+            if (placed == bucket->count) break;
+            while (placed > 0) taken[slots[--placed]] = 0;
+        }
+        
+        if (seed == MAX_SEED) {
+            fprintf(stderr, "gazetteer_gen: no seed places bucket %zu\n", bucket->index);
+            rc = -1;
+            break;
+        }
+        displace[bucket->index] = seed;
+        for (size_t k = 0; k < bucket->count; k++) place[slots[k]] = bucket->keys[k];
+    }
+    
+    for (size_t b = 0; b < bucket_count; b++) free(buckets[b].keys);
+    free(buckets);
+    free(taken);
+    free(slots);
+    return rc;
+}
+
+/* ---- k-d tree ----------------------------------------------------------- */
+
+static int sort_axis;
+
+static int by_axis(const void* a, const void* b) {
+    double x = ((const Place*)a)->xyz[sort_axis];
+    double y = ((const Place*)b)->xyz[sort_axis];
+    return (x > y) - (x < y);
+}
+
+// Split on the axis the range is widest along, median at the middle
+static void build_tree(size_t lo, size_t hi) {
+    if (hi - lo <= 1) {
+        if (hi > lo) places[lo].axis = 0;
+        return;
+    }
+    double spread[3];
+    for (int a = 0; a < 3; a++) {
+        double min = places[lo].xyz[a], max = min;
+        for (size_t i = lo + 1; i < hi; i++) {
+            if (places[i].xyz[a] < min) min = places[i].xyz[a];
+            if (places[i].xyz[a] > max) max = places[i].xyz[a];
+        }
+        spread[a] = max - min;
+    }
+    sort_axis = spread[1] > spread[0] ? 1 : 0;
+    if (spread[2] > spread[sort_axis]) sort_axis = 2;
+    qsort(places + lo, hi - lo, sizeof(Place), by_axis);
+    
+    size_t mid = lo + (hi - lo) / 2;
+    places[mid].axis = sort_axis;
+    build_tree(lo, mid);
+    build_tree(mid + 1, hi);
+}
+
+static void collect_places(void) {
+    for (size_t i = 0; i < row_count; i++) {
+        if (rows[i].alias) continue;
+        Place* place = &places[place_count++];
+        double lat = rows[i].lat * M_PI / 180.0;
+        double lon = rows[i].lon * M_PI / 180.0;
+        place->row = &rows[i];
+        place->xyz[0] = cos(lat) * cos(lon);
+        place->xyz[1] = cos(lat) * sin(lon);
+        place->xyz[2] = sin(lat);
+    }
+    build_tree(0, place_count);
+}
+
+// Non-ASCII bytes become octal escapes so the output is plain ASCII
+static void print_string(const char* s) {
+    putchar('"');
+    for (const unsigned char* p = (const unsigned char*)s; *p; p++) {
+        if (*p == '"' || *p == '\\') printf("\\%c", *p);
+        else if (*p < 0x20 || *p >= 0x7f) printf("\\%03o", *p);
+        else putchar(*p);
+    }
+    putchar('"');
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s cities.csv > gazetteer_data.c\n", argv[0]);
+        return 1;
+    }
+    FILE* in = fopen(argv[1], "r");
+    if (!in) {
+        perror(argv[1]);
+        return 1;
+    }
+    int rc = read_rows(in);
+    fclose(in);
+    if (rc < 0) return 1;
+    if (row_count == 0) {
+        fprintf(stderr, "%s: no cities\n", argv[1]);
+        return 1;
+    }
+    
+    size_t bucket_count = (row_count + 3) / 4;
+    uint32_t* displace = malloc_safe(bucket_count * sizeof(uint32_t));
+    size_t* place = malloc_safe(row_count * sizeof(size_t));
+    if (build(displace, bucket_count, place) < 0) return 1;
+    
+    printf("// Generated by tools/gazetteer_gen from %s; do not edit\n\n", argv[1]);
+    printf("#include \"../include/gazetteer.h\"\n\n");
+    printf("const size_t gazetteer_count = %zu;\n", row_count);
+    printf("const size_t gazetteer_bucket_count = %zu;\n\n", bucket_count);
+    
+    printf("const uint32_t gazetteer_displace[] = {");
+    for (size_t b = 0; b < bucket_count; b++) {
+        printf("%s%u,", b % 8 ? " " : "\n    ", displace[b]);
+    }
+    printf("\n};\n\n");
+    
+    printf("const GazetteerEntry gazetteer_entries[] = {\n");
+    for (size_t i = 0; i < row_count; i++) {
+        const Row* row = &rows[place[i]];
+        printf("    { ");
+        print_string(row->key);
+        printf(", ");
+        print_string(row->name);
+        printf(", ");
+        print_string(row->country);
+        printf(", %.4f, %.4f },\n", row->lat, row->lon);
+    }
+    printf("};\n\n");
+    
+    collect_places();
+    printf("const size_t gazetteer_place_count = %zu;\n\n", place_count);
+    printf("const GazetteerPlace gazetteer_places[] = {\n");
+    for (size_t i = 0; i < place_count; i++) {
+        const Place* place = &places[i];
+        printf("    { ");
+        print_string(place->row->name);
+        printf(", ");
+        print_string(place->row->country);
+        printf(", %.4f, %.4f, { %.9f, %.9f, %.9f }, %d },\n", place->row->lat, place->row->lon,
+               place->xyz[0], place->xyz[1], place->xyz[2], place->axis);
+    }
+    printf("};\n");
+    
+    free(displace);
+    free(place);
+    return 0;
+}